@@ -0,0 +1,256 @@
+#include "FlowerApi.h"
+#include "FlowerField.h"
+#include "FlowerMerge.h"
+#include "FlowerNoise.h"
+
+#include <math.h>
+#include <new>
+
+static_assert(sizeof(Vec2) == 2 * sizeof(float), "Field storage is exposed as interleaved float pairs");
+
+struct FlowerField
+{
+	VectorField vf;
+
+	// Kept between merges, so only tiles edited since the previous merge are hashed again
+	mutable FieldTileHashes hashes;
+};
+
+uint32_t flowerGetApiVersion(void)
+{
+	return FLOWER_API_VERSION;
+}
+
+size_t flowerFieldMemorySize(uint32_t width, uint32_t height)
+{
+	return size_t(width) * size_t(height) * sizeof(Vec2);
+}
+
+FlowerResult flowerCreateField(uint32_t width, uint32_t height, void* memory, size_t memorySize, FlowerField** outField)
+{
+	if (!outField || width == 0 || height == 0) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	*outField = nullptr;
+
+	// Cells are indexed with 32 bit integers
+	if (u64(width) * u64(height) > u64(UINT32_MAX)) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	if (memory)
+	{
+		if (memorySize < flowerFieldMemorySize(width, height)) return FLOWER_ERROR_BUFFER_TOO_SMALL;
+		if (uintptr_t(memory) % alignof(float) != 0) return FLOWER_ERROR_INVALID_ARGUMENT;
+	}
+
+	FlowerField* field = new (std::nothrow) FlowerField;
+	if (!field) return FLOWER_ERROR_OUT_OF_MEMORY;
+
+	Vec2* storage = reinterpret_cast<Vec2*>(memory);
+	if (!storage)
+	{
+		storage = new (std::nothrow) Vec2[size_t(width) * size_t(height)];
+		if (!storage)
+		{
+			delete field;
+			return FLOWER_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	try
+	{
+		createVectorField(field->vf, width, height, storage);
+	}
+	catch (const std::bad_alloc&)
+	{
+		if (!memory) delete[] storage;
+		delete field;
+		return FLOWER_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (!memory)
+	{
+		field->vf.ownsData = true;
+		initVectorField(field->vf, Vec2(0.0f));
+	}
+
+	*outField = field;
+
+	return FLOWER_OK;
+}
+
+void flowerDestroyField(FlowerField* field)
+{
+	delete field;
+}
+
+FlowerResult flowerFieldGetView(FlowerField* field, FlowerFieldView* outView)
+{
+	if (!field || !outView) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	outView->data = reinterpret_cast<float*>(field->vf.data);
+	outView->width = field->vf.width;
+	outView->height = field->vf.height;
+	outView->rowStride = field->vf.width * 2;
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerFieldInvalidate(FlowerField* field, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	if (!field || x0 > x1 || y0 > y1) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	FieldRect rect = { x0, y0, min(x1, field->vf.width), min(y1, field->vf.height) };
+	markFieldDirty(field->vf, rect);
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerFieldFill(FlowerField* field, float x, float y)
+{
+	if (!field) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	initVectorField(field->vf, Vec2(x, y));
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerApplyStrokes(FlowerField* field, const FlowerStroke* strokes, uint32_t strokeCount)
+{
+	if (!field || (!strokes && strokeCount)) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	try
+	{
+		// One call for the whole batch, so dabs are binned by tile and each tile is visited once
+		std::vector<BrushStroke> brushStrokes(strokeCount);
+		for (uint32_t i = 0; i < strokeCount; ++i)
+		{
+			const FlowerStroke& s = strokes[i];
+
+			BrushStroke& stroke = brushStrokes[i];
+			stroke.tool = BrushTool(s.tool);
+			stroke.prev = Vec2(s.prevX, s.prevY);
+			stroke.cur = Vec2(s.x, s.y);
+			stroke.radius = s.radius;
+
+			if (!isValidBrushStroke(stroke)) return FLOWER_ERROR_INVALID_ARGUMENT;
+		}
+
+		applyStrokes(field->vf, brushStrokes.data(), strokeCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return FLOWER_ERROR_OUT_OF_MEMORY;
+	}
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerApplyFilter(FlowerField* field, FlowerFilter filter, uint32_t param)
+{
+	if (!field) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	FieldFilter fieldFilter;
+	switch (filter)
+	{
+	case FLOWER_FILTER_SMOOTH:    fieldFilter = FieldFilter::Smooth; break;
+	case FLOWER_FILTER_NORMALIZE: fieldFilter = FieldFilter::Normalize; break;
+	default: return FLOWER_ERROR_INVALID_ARGUMENT;
+	}
+
+	try
+	{
+		applyFilter(field->vf, fieldFilter, param);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return FLOWER_ERROR_OUT_OF_MEMORY;
+	}
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerGenerateCurlNoise(FlowerField* field, uint32_t seed, float frequency, uint32_t octaves, float amplitude)
+{
+	if (!field || !(frequency > 0.0f) || octaves == 0) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	CurlNoiseSettings settings;
+	settings.seed = seed;
+	settings.frequency = frequency;
+	settings.octaves = octaves;
+	settings.amplitude = amplitude;
+
+	generateCurlNoise(field->vf, settings);
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerExportRGBA8(const FlowerField* field, void* pixels, size_t pixelsSize, uint32_t rowPitch)
+{
+	if (!field || !pixels) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	const VectorField& vf = field->vf;
+
+	if (rowPitch == 0) rowPitch = vf.width * 4;
+	if (rowPitch < vf.width * 4) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	const size_t requiredSize = size_t(rowPitch) * (vf.height - 1) + vf.width * 4;
+	if (pixelsSize < requiredSize) return FLOWER_ERROR_BUFFER_TOO_SMALL;
+
+	exportFlowmap(vf, reinterpret_cast<u8*>(pixels), rowPitch);
+
+	return FLOWER_OK;
+}
+
+// Wraps into [0, 1), so sample() only sees coordinates it can convert to cells. NaN and infinity map to 0.
+static float wrapCoordinate(float t)
+{
+	const float wrapped = t - floorf(t);
+	return wrapped >= 0.0f && wrapped < 1.0f ? wrapped : 0.0f;
+}
+
+FlowerResult flowerSample(const FlowerField* field, const float* uv, float* outVectors, uint32_t count)
+{
+	if (!field || (count && (!uv || !outVectors))) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Vec2 v = sample(field->vf, Vec2(wrapCoordinate(uv[i * 2 + 0]), wrapCoordinate(uv[i * 2 + 1])));
+		outVectors[i * 2 + 0] = v.x;
+		outVectors[i * 2 + 1] = v.y;
+	}
+
+	return FLOWER_OK;
+}
+
+FlowerResult flowerMergeFields(FlowerField* ours, const FlowerField* base, const FlowerField* theirs,
+	uint32_t* outConflictTiles, uint32_t maxConflictTiles, uint32_t* outConflictCount)
+{
+	if (!ours || !base || !theirs || (maxConflictTiles && !outConflictTiles)) return FLOWER_ERROR_INVALID_ARGUMENT;
+	if (ours == base || ours == theirs) return FLOWER_ERROR_INVALID_ARGUMENT;
+
+	const VectorField& vf = ours->vf;
+	if (base->vf.width != vf.width || base->vf.height != vf.height ||
+		theirs->vf.width != vf.width || theirs->vf.height != vf.height)
+	{
+		return FLOWER_ERROR_INVALID_ARGUMENT;
+	}
+
+	std::vector<u32> conflictTiles;
+	try
+	{
+		mergeFields(ours->vf, ours->hashes, base->vf, base->hashes, theirs->vf, theirs->hashes, conflictTiles);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return FLOWER_ERROR_OUT_OF_MEMORY;
+	}
+
+	const uint32_t conflictCount = uint32_t(conflictTiles.size());
+	for (uint32_t i = 0; i < min(conflictCount, maxConflictTiles); ++i)
+	{
+		outConflictTiles[i] = conflictTiles[i];
+	}
+
+	if (outConflictCount) *outConflictCount = conflictCount;
+
+	return FLOWER_OK;
+}
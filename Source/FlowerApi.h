@@ -0,0 +1,114 @@
+#ifndef FLOWER_API_H
+#define FLOWER_API_H
+
+// Embeddable C interface to the Flower field core.
+// All functions are safe to call concurrently on different fields.
+// Calls operating on the same field must be serialized by the caller.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#	if defined(FLOWER_API_EXPORTS)
+#		define FLOWER_API __declspec(dllexport)
+#	else
+#		define FLOWER_API __declspec(dllimport)
+#	endif
+#else
+#	define FLOWER_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLOWER_API_VERSION 1
+
+typedef struct FlowerField FlowerField;
+
+typedef enum FlowerResult
+{
+	FLOWER_OK = 0,
+	FLOWER_ERROR_INVALID_ARGUMENT = 1,
+	FLOWER_ERROR_OUT_OF_MEMORY = 2,
+	FLOWER_ERROR_BUFFER_TOO_SMALL = 3,
+} FlowerResult;
+
+typedef enum FlowerTool
+{
+	FLOWER_TOOL_COMB = 0,
+	FLOWER_TOOL_DAMPEN = 1,
+} FlowerTool;
+
+typedef enum FlowerFilter
+{
+	FLOWER_FILTER_SMOOTH = 0,    // box blur, param is the radius in cells
+	FLOWER_FILTER_NORMALIZE = 1, // rescale non-zero vectors to unit length
+} FlowerFilter;
+
+// Brush positions and radius are in normalized [0, 1] field coordinates.
+// Dampen strokes only use the current position.
+// Radius must be in [1e-6, 1] and positions in [-1, 2], other strokes (including NaN and infinity) are rejected.
+typedef struct FlowerStroke
+{
+	uint32_t tool; // FlowerTool
+	float prevX, prevY;
+	float x, y;
+	float radius;
+} FlowerStroke;
+
+// Direct view of field storage: width * height interleaved (x, y) float pairs.
+// Row r starts at data + r * rowStride floats.
+// The view stays valid until the field is destroyed.
+// Writes made through the view must be reported with flowerFieldInvalidate().
+typedef struct FlowerFieldView
+{
+	float* data;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rowStride;
+} FlowerFieldView;
+
+FLOWER_API uint32_t flowerGetApiVersion(void);
+
+// Number of bytes required for caller-provided field storage.
+FLOWER_API size_t flowerFieldMemorySize(uint32_t width, uint32_t height);
+
+// Memory is optional. When provided, it must be at least flowerFieldMemorySize() bytes,
+// aligned to 4 bytes and must outlive the field. Its contents are used as the initial field.
+// When memory is null, the field is allocated by the library and cleared to zero.
+// width * height must fit in 32 bits.
+FLOWER_API FlowerResult flowerCreateField(uint32_t width, uint32_t height, void* memory, size_t memorySize, FlowerField** outField);
+FLOWER_API void flowerDestroyField(FlowerField* field);
+
+FLOWER_API FlowerResult flowerFieldGetView(FlowerField* field, FlowerFieldView* outView);
+// Marks cells [x0, x1) x [y0, y1) as modified outside the library, so cached tile data is rebuilt.
+FLOWER_API FlowerResult flowerFieldInvalidate(FlowerField* field, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+FLOWER_API FlowerResult flowerFieldFill(FlowerField* field, float x, float y);
+
+FLOWER_API FlowerResult flowerApplyStrokes(FlowerField* field, const FlowerStroke* strokes, uint32_t strokeCount);
+FLOWER_API FlowerResult flowerApplyFilter(FlowerField* field, FlowerFilter filter, uint32_t param);
+
+// Replaces the field with divergence-free curl noise.
+// Frequency is the number of noise periods across the longer side of the field at the first octave.
+FLOWER_API FlowerResult flowerGenerateCurlNoise(FlowerField* field, uint32_t seed, float frequency, uint32_t octaves, float amplitude);
+
+// Writes width * height RGBA8 texels, rowPitch is in bytes (0 means tightly packed).
+FLOWER_API FlowerResult flowerExportRGBA8(const FlowerField* field, void* pixels, size_t pixelsSize, uint32_t rowPitch);
+
+// Nearest-cell lookup of count (u, v) pairs into count (x, y) pairs.
+// Coordinates wrap around the field, NaN and infinite coordinates sample cell (0, 0).
+FLOWER_API FlowerResult flowerSample(const FlowerField* field, const float* uv, float* outVectors, uint32_t count);
+
+// Three-way merge of two edits of a common base: the changes theirs made to base are applied to ours.
+// Cells changed differently on both sides keep ours. Their 32x32 cell tiles are reported as conflicts,
+// as row-major tile indices: up to maxConflictTiles are written, outConflictCount (optional) receives the total.
+// Cached tile hashes of all three fields are updated, so none of them may be used concurrently.
+FLOWER_API FlowerResult flowerMergeFields(FlowerField* ours, const FlowerField* base, const FlowerField* theirs,
+	uint32_t* outConflictTiles, uint32_t maxConflictTiles, uint32_t* outConflictCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLOWER_API_H
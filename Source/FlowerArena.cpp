@@ -0,0 +1,134 @@
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+#include <stdlib.h>
+
+static void* heapAllocate(LinearArena& arena, size_t size, size_t alignment)
+{
+	arena.heapAllocationCount++;
+
+	// malloc alignment covers everything stored in the arena
+	RUSH_ASSERT(alignment <= alignof(max_align_t));
+	(void)alignment;
+
+	return malloc(size ? size : 1);
+}
+
+// Overflow list storage is allocated by the vector, the count has to follow it
+static void reserveOverflowBlocks(LinearArena& arena, size_t count)
+{
+	if (count <= arena.overflowBlocks.capacity()) return;
+
+	arena.heapAllocationCount++;
+	arena.overflowBlocks.reserve(count);
+}
+
+static void* allocateLinear(LinearArena& arena, size_t size, size_t alignment)
+{
+	size_t alignedOffset = (arena.offset + alignment - 1) & ~(alignment - 1);
+	if (alignedOffset + size <= arena.capacity)
+	{
+		arena.offset = alignedOffset + size;
+		return arena.memory + alignedOffset;
+	}
+
+	reserveOverflowBlocks(arena, max<size_t>(16, arena.overflowBlocks.size() * 2));
+
+	void* block = heapAllocate(arena, size, alignment);
+	arena.overflowBlocks.push_back(block);
+	arena.overflowSize += size + alignment;
+
+	return block;
+}
+
+static void freeOverflowBlocks(LinearArena& arena)
+{
+	for (void* block : arena.overflowBlocks)
+	{
+		free(block);
+	}
+	arena.overflowBlocks.clear();
+}
+
+static void resetLinear(LinearArena& arena)
+{
+	const size_t overflowBlockCount = arena.overflowBlocks.size();
+	freeOverflowBlocks(arena);
+
+	if (arena.overflowSize)
+	{
+		// Grow to the peak usage of this frame, with some slack
+		size_t newCapacity = arena.capacity + arena.overflowSize;
+		newCapacity += newCapacity / 2;
+
+		free(arena.memory);
+		arena.memory = reinterpret_cast<u8*>(heapAllocate(arena, newCapacity, alignof(max_align_t)));
+		arena.capacity = newCapacity;
+
+		// Room for twice this frame's overflow, in case the next peak overflows again
+		reserveOverflowBlocks(arena, overflowBlockCount * 2);
+	}
+
+	arena.offset = 0;
+	arena.overflowSize = 0;
+}
+
+void createFrameArena(FrameArena& arena, const JobSystem* js, size_t initialCapacityPerThread)
+{
+	destroyFrameArena(arena);
+
+	arena.jobSystem = js;
+	arena.threads.resize(getJobThreadCount(js) + 1);
+
+	for (LinearArena& it : arena.threads)
+	{
+		it.memory = reinterpret_cast<u8*>(heapAllocate(it, initialCapacityPerThread, alignof(max_align_t)));
+		it.capacity = initialCapacityPerThread;
+		reserveOverflowBlocks(it, 16);
+	}
+}
+
+void destroyFrameArena(FrameArena& arena)
+{
+	// Frees without growing, unlike a reset
+	for (LinearArena& it : arena.threads)
+	{
+		freeOverflowBlocks(it);
+		free(it.memory);
+	}
+
+	arena.threads.clear();
+	arena.jobSystem = nullptr;
+}
+
+void resetFrameArena(FrameArena& arena)
+{
+	for (LinearArena& it : arena.threads)
+	{
+		resetLinear(it);
+	}
+}
+
+void* allocateFrameMemory(FrameArena& arena, size_t size, size_t alignment)
+{
+	const u32 threadIndex = getJobThreadIndex(arena.jobSystem);
+	LinearArena& linear = arena.threads[threadIndex];
+
+	if (threadIndex == getJobThreadCount(arena.jobSystem))
+	{
+		std::lock_guard<std::mutex> guard(arena.foreignThreadLock);
+		return allocateLinear(linear, size, alignment);
+	}
+
+	return allocateLinear(linear, size, alignment);
+}
+
+u64 getFrameArenaHeapAllocationCount(const FrameArena& arena)
+{
+	u64 result = 0;
+	for (const LinearArena& it : arena.threads)
+	{
+		result += it.heapAllocationCount;
+	}
+	return result;
+}
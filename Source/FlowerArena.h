@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+struct JobSystem;
+
+// Linear allocator for data that only lives until the end of the frame.
+// Requests that do not fit are served from the heap and counted; the arena grows to the
+// frame's peak usage on reset, so steady-state frames do not touch the heap at all.
+struct LinearArena
+{
+	u8* memory = nullptr;
+	size_t capacity = 0;
+	size_t offset = 0;
+
+	size_t overflowSize = 0;
+	std::vector<void*> overflowBlocks;
+
+	u64 heapAllocationCount = 0;
+};
+
+// One sub-arena per job thread, so allocations never contend.
+// The last sub-arena serves threads outside of the job system and is guarded by a lock.
+struct FrameArena
+{
+	std::vector<LinearArena> threads;
+	std::mutex foreignThreadLock;
+	const JobSystem* jobSystem = nullptr;
+};
+
+void createFrameArena(FrameArena& arena, const JobSystem* js, size_t initialCapacityPerThread);
+void destroyFrameArena(FrameArena& arena);
+
+// Invalidates every allocation made since the previous reset. Must not overlap with allocations.
+void resetFrameArena(FrameArena& arena);
+
+void* allocateFrameMemory(FrameArena& arena, size_t size, size_t alignment);
+
+// Number of heap allocations made by the arena since creation, including its own growth.
+u64 getFrameArenaHeapAllocationCount(const FrameArena& arena);
+
+// Uninitialized storage for count trivially destructible elements, valid until the next reset.
+template <typename T>
+T* allocateFrame(FrameArena& arena, u32 count)
+{
+	return reinterpret_cast<T*>(allocateFrameMemory(arena, sizeof(T) * count, alignof(T)));
+}
+
+// Scratch storage for functions that run within frames as well as outside of them (the library API, the server).
+// Comes from the frame arena when one is given and from the heap otherwise, in which case it is freed with the array.
+template <typename T>
+struct FrameArray
+{
+	FrameArray(FrameArena* arena, u32 count)
+	{
+		if (arena)
+		{
+			data = allocateFrame<T>(*arena, count);
+		}
+		else
+		{
+			heap.reset(new T[count]);
+			data = heap.get();
+		}
+	}
+
+	T& operator[](u32 i) { return data[i]; }
+	const T& operator[](u32 i) const { return data[i]; }
+
+	T* data = nullptr;
+	std::unique_ptr<T[]> heap;
+};
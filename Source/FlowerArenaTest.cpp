@@ -0,0 +1,166 @@
+#include "FlowerArena.h"
+#include "FlowerDensity.h"
+#include "FlowerDerived.h"
+#include "FlowerJobs.h"
+#include "FlowerLayers.h"
+#include "FlowerStats.h"
+
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Runs the per-frame field updates of the editor and counts every operator new made by them once the caches
+// are warm. Steady-state frames must not allocate: scratch memory comes from the frame arena, which must not grow.
+// Usage: FlowerArenaTest
+
+static std::atomic<u64> g_allocationCount = { 0 };
+
+// Every replacement below goes through this pair, so allocation and release always match
+static void* countedAlloc(size_t size) noexcept
+{
+	g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+// GCC assumes that pointers reaching operator delete come from the standard operator new and flags the free() with
+// -Wmismatched-new-delete, even though the replaced operator new above allocated them with malloc()
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static void countedFree(void* p) noexcept
+{
+	free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+void* operator new(size_t size)
+{
+	if (void* result = countedAlloc(size)) return result;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+struct FrameCaches
+{
+	FieldStats stats;
+	FieldDerivedMaps derived;
+	FieldMipChain mips;
+};
+
+// Brushes of a few sizes swept across the field, so frames touch different tiles and multires levels
+static BrushStroke getFrameStroke(u32 frame)
+{
+	const float t = float(frame % 64) / 64.0f;
+	const float radius = (frame / 64) % 2 ? 0.15f : 0.02f;
+
+	BrushStroke stroke;
+	stroke.tool = frame % 7 ? BrushTool::Comb : BrushTool::Dampen;
+	stroke.prev = Vec2(t, 0.5f + 0.3f * t);
+	stroke.cur = Vec2(t + 0.01f, 0.5f + 0.3f * t);
+	stroke.radius = radius;
+	return stroke;
+}
+
+static void runFrame(LayerStack& stack, FrameCaches& caches, DensityGrid& density, const Vec2* particles,
+	u32 particleCount, u32 frame, JobSystem& js, FrameArena& arena)
+{
+	BrushStroke* strokes = allocateFrame<BrushStroke>(arena, 1);
+	strokes[0] = getFrameStroke(frame);
+
+	FieldLayer& layer = getActiveLayer(stack);
+	applyMultiresStrokes(layer.detail, strokes, 1, &js, &arena);
+
+	const FieldRect visible = { 0, 0, stack.width / 2, stack.height };
+	resolveLayers(stack, visible, &js, &arena);
+	updateLayerComposite(stack, &js, &arena);
+
+	updateFieldStats(caches.stats, stack.composite, &js, &arena);
+	updateDerivedMaps(caches.derived, stack.composite, &js, &arena);
+
+	// Overlay colors of one quantity, cycling through all of them and recoloring everything when the range changes
+	const FieldQuantity quantity = FieldQuantity(frame % u32(FieldQuantity::Count));
+	const float range = (frame / 32) % 2 ? 2.0f : 1.0f;
+	updateDerivedImage(caches.derived, quantity, range, &js, &arena);
+	updateFieldMipChain(caches.mips, stack.composite, &js, &arena);
+
+	const Vec2 domainMax = Vec2(float(stack.width), float(stack.height));
+	splatDensity(density, particles, particleCount, Vec2(0.0f), domainMax, 0.9f, &js, &arena);
+
+	resetFrameArena(arena);
+}
+
+int main()
+{
+	static constexpr u32 warmupFrameCount = 256;
+	static constexpr u32 frameCount = 512;
+	static constexpr u32 particleCount = 100000;
+
+	JobSystem js;
+	startJobSystem(js, JobSystemDesc());
+
+	FrameArena arena;
+	createFrameArena(arena, &js, 256 * 1024);
+
+	LayerStack stack;
+	createLayerStack(stack, 1024, 768);
+	addLayer(stack, LayerBlendMode::NormalizeAdd, 0.5f);
+
+	FrameCaches caches;
+
+	DensityGrid density;
+	createDensityGrid(density, 256, 192, &js);
+
+	std::vector<Vec2> particles(particleCount);
+	for (u32 i = 0; i < particleCount; ++i)
+	{
+		particles[i] = Vec2(float(i % 1024), float((i * 7) % 768));
+	}
+
+	// Warm-up covers every stroke size and position, so caches and the arena reach their peak sizes
+	for (u32 frame = 0; frame < warmupFrameCount; ++frame)
+	{
+		runFrame(stack, caches, density, particles.data(), particleCount, frame, js, arena);
+	}
+
+	const u64 arenaHeapAllocationCount = getFrameArenaHeapAllocationCount(arena);
+	const u64 allocationCount = g_allocationCount.load();
+
+	for (u32 frame = 0; frame < frameCount; ++frame)
+	{
+		runFrame(stack, caches, density, particles.data(), particleCount, frame, js, arena);
+	}
+
+	const u64 frameAllocationCount = g_allocationCount.load() - allocationCount;
+	const u64 arenaGrowthCount = getFrameArenaHeapAllocationCount(arena) - arenaHeapAllocationCount;
+
+	stopJobSystem(js);
+	destroyFrameArena(arena);
+
+	printf("%u frames: %llu operator new calls, %llu frame arena heap allocations\n", frameCount,
+		(unsigned long long)frameAllocationCount, (unsigned long long)arenaGrowthCount);
+
+	return frameAllocationCount == 0 && arenaGrowthCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// Stand-in client for the baking service.
+// Creates a document, combs a few strokes into it, smooths it and saves the exported flowmap as TGA.
+// Usage: FlowerClient [socket path] [output.tga]
+
+#include "FlowerImage.h"
+#include "FlowerProtocol.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+static bool call(int fd, ServerCommand command, uint32_t document, const void* payload, uint32_t payloadSize, std::vector<uint8_t>* result = nullptr)
+{
+	ServerRequestHeader header = {};
+	header.magic = ServerProtocolMagic;
+	header.command = uint32_t(command);
+	header.document = document;
+	header.payloadSize = payloadSize;
+
+	if (!writeAll(fd, &header, sizeof(header)) || !writeAll(fd, payload, payloadSize)) return false;
+
+	ServerResponseHeader response;
+	if (!readAll(fd, &response, sizeof(response)) || response.magic != ServerProtocolMagic) return false;
+
+	std::vector<uint8_t> data(response.payloadSize);
+	if (!readAll(fd, data.data(), data.size())) return false;
+
+	if (response.status != uint32_t(ServerStatus::Ok))
+	{
+		fprintf(stderr, "Command %u failed with status %u\n", header.command, response.status);
+		return false;
+	}
+
+	if (result) *result = std::move(data);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* socketPath = argc > 1 ? argv[1] : ServerDefaultSocketPath;
+	const char* outputPath = argc > 2 ? argv[2] : "flowmap.tga";
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		perror("connect");
+		return 1;
+	}
+
+	std::vector<uint8_t> result;
+
+	ServerCreateDocument desc = { 256, 256 };
+	if (!call(fd, ServerCommand::CreateDocument, 0, &desc, sizeof(desc), &result) || result.size() != sizeof(uint32_t)) return 1;
+
+	uint32_t document;
+	memcpy(&document, result.data(), sizeof(document));
+
+	// Sweep a circular stroke around the center of the field
+	std::vector<FlowerStroke> strokes;
+	const uint32_t segmentCount = 64;
+	for (uint32_t i = 0; i < segmentCount; ++i)
+	{
+		float a0 = 6.2831853f * float(i) / segmentCount;
+		float a1 = 6.2831853f * float(i + 1) / segmentCount;
+
+		FlowerStroke s;
+		s.tool = FLOWER_TOOL_COMB;
+		s.prevX = 0.5f + cosf(a0) * 0.3f;
+		s.prevY = 0.5f + sinf(a0) * 0.3f;
+		s.x = 0.5f + cosf(a1) * 0.3f;
+		s.y = 0.5f + sinf(a1) * 0.3f;
+		s.radius = 0.1f;
+		strokes.push_back(s);
+	}
+
+	ServerApplyFilter filter = { FLOWER_FILTER_SMOOTH, 2 };
+
+	if (!call(fd, ServerCommand::ApplyStrokes, document, strokes.data(), uint32_t(strokes.size() * sizeof(FlowerStroke))) ||
+		!call(fd, ServerCommand::ApplyFilter, document, &filter, sizeof(filter)) ||
+		!call(fd, ServerCommand::Export, document, nullptr, 0, &result) ||
+		result.size() < sizeof(ServerExportHeader))
+	{
+		return 1;
+	}
+
+	ServerExportHeader exportHeader;
+	memcpy(&exportHeader, result.data(), sizeof(exportHeader));
+
+	call(fd, ServerCommand::DestroyDocument, document, nullptr, 0);
+	close(fd);
+
+	if (!saveTga(outputPath, exportHeader.width, exportHeader.height, result.data() + sizeof(exportHeader)))
+	{
+		fprintf(stderr, "Failed to write %s\n", outputPath);
+		return 1;
+	}
+
+	printf("Saved %ux%u flowmap to %s\n", exportHeader.width, exportHeader.height, outputPath);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#include "FlowerDensity.h"
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+#include <math.h>
+
+static constexpr u32 rowsPerJob = 16;
+static constexpr u32 particlesPerJob = 4096;
+
+void createDensityGrid(DensityGrid& grid, u32 width, u32 height, const JobSystem* jobs)
+{
+	const u32 cellCount = width * height;
+
+	grid.width = width;
+	grid.height = height;
+	grid.domainMin = Vec2(0.0f);
+	grid.domainMax = Vec2(0.0f);
+	grid.density.assign(cellCount, 0.0f);
+	grid.threadCounts.resize(getJobThreadCount(jobs) + 1);
+	for (std::vector<u32>& counts : grid.threadCounts)
+	{
+		counts.assign(cellCount, 0);
+	}
+	grid.threadTouched.assign(grid.threadCounts.size(), 0);
+	grid.maxDensity = 0.0f;
+	grid.pixels.assign(cellCount, 0xFF000000);
+}
+
+static void splatPositions(DensityGrid& grid, u32 threadIndex, const Vec2* positions, u32 begin, u32 end,
+	const Vec2& domainMin, const Vec2& scale)
+{
+	u32* counts = grid.threadCounts[threadIndex].data();
+	grid.threadTouched[threadIndex] = 1;
+
+	for (u32 i = begin; i < end; ++i)
+	{
+		const Vec2 p = (positions[i] - domainMin) * scale;
+		if (p.x >= 0.0f && p.y >= 0.0f && p.x < float(grid.width) && p.y < float(grid.height))
+		{
+			counts[u32(p.x) + u32(p.y) * grid.width]++;
+		}
+	}
+}
+
+void splatDensity(DensityGrid& grid, const Vec2* positions, u32 count, const Vec2& domainMin, const Vec2& domainMax,
+	float decay, JobSystem* jobs, FrameArena* arena)
+{
+	// The grid may have been created for a different job system
+	RUSH_ASSERT(getJobThreadCount(jobs) < grid.threadCounts.size());
+
+	if (domainMin != grid.domainMin || domainMax != grid.domainMax)
+	{
+		grid.domainMin = domainMin;
+		grid.domainMax = domainMax;
+		decay = 0.0f;
+	}
+
+	const Vec2 scale = Vec2(float(grid.width), float(grid.height)) / (domainMax - domainMin);
+	const u32 foreignThreadIndex = getJobThreadCount(jobs);
+
+	parallelFor(jobs, count, particlesPerJob, [&](u32 begin, u32 end)
+	{
+		const u32 threadIndex = getJobThreadIndex(jobs);
+		if (threadIndex == foreignThreadIndex)
+		{
+			std::lock_guard<std::mutex> guard(grid.foreignThreadLock);
+			splatPositions(grid, threadIndex, positions, begin, end, domainMin, scale);
+		}
+		else
+		{
+			splatPositions(grid, threadIndex, positions, begin, end, domainMin, scale);
+		}
+	});
+
+	// Only histograms that received particles this frame are summed and cleared
+	FrameArray<u32*> touchedCounts(arena, u32(grid.threadCounts.size()));
+	u32 touchedCount = 0;
+	for (u32 i = 0; i < grid.threadCounts.size(); ++i)
+	{
+		if (!grid.threadTouched[i]) continue;
+
+		touchedCounts[touchedCount++] = grid.threadCounts[i].data();
+		grid.threadTouched[i] = 0;
+	}
+
+	FrameArray<float> rowMax(arena, grid.height);
+
+	parallelFor(jobs, grid.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		// Clearing the counts could write to the grid width as far as the compiler knows, which would keep
+		// the loops below from vectorizing
+		const u32 width = grid.width;
+
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			const u32 rowOffset = y * width;
+			float* density = grid.density.data() + rowOffset;
+
+			for (u32 x = 0; x < width; ++x)
+			{
+				density[x] *= decay;
+			}
+
+			for (u32 i = 0; i < touchedCount; ++i)
+			{
+				u32* counts = touchedCounts[i] + rowOffset;
+				for (u32 x = 0; x < width; ++x)
+				{
+					density[x] += float(counts[x]);
+					counts[x] = 0;
+				}
+			}
+
+			float m = 0.0f;
+			for (u32 x = 0; x < width; ++x)
+			{
+				m = max(m, density[x]);
+			}
+			rowMax[y] = m;
+		}
+	});
+
+	grid.maxDensity = 0.0f;
+	for (u32 y = 0; y < grid.height; ++y)
+	{
+		grid.maxDensity = max(grid.maxDensity, rowMax[y]);
+	}
+}
+
+struct DensityColorMap
+{
+	static constexpr u32 size = 256;
+	u32 colors[size];
+
+	DensityColorMap()
+	{
+		static const float keys[][3] = {
+			{ 0.0f, 0.0f, 0.0f },
+			{ 0.8f, 0.1f, 0.0f },
+			{ 1.0f, 0.8f, 0.0f },
+			{ 1.0f, 1.0f, 1.0f },
+		};
+		const u32 segmentCount = RUSH_COUNTOF(keys) - 1;
+
+		for (u32 i = 0; i < size; ++i)
+		{
+			const float t = float(i) / float(size - 1) * float(segmentCount);
+			const u32 segment = min(u32(t), segmentCount - 1);
+			const float f = t - float(segment);
+
+			u32 color = 0xFF000000;
+			for (u32 c = 0; c < 3; ++c)
+			{
+				const float value = keys[segment][c] + (keys[segment + 1][c] - keys[segment][c]) * f;
+				color |= u32(value * 255.0f + 0.5f) << (c * 8);
+			}
+			colors[i] = color;
+		}
+	}
+};
+
+void colorizeDensity(DensityGrid& grid, JobSystem* jobs)
+{
+	static const DensityColorMap colorMap;
+
+	const float scale = grid.maxDensity > 0.0f ? float(DensityColorMap::size - 1) / logf(1.0f + grid.maxDensity) : 0.0f;
+
+	parallelFor(jobs, grid.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			const float* density = grid.density.data() + y * grid.width;
+			u32* out = grid.pixels.data() + y * grid.width;
+
+			for (u32 x = 0; x < grid.width; ++x)
+			{
+				const u32 index = min(u32(logf(1.0f + density[x]) * scale), DensityColorMap::size - 1);
+				out[x] = colorMap.colors[index];
+			}
+		}
+	});
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <mutex>
+#include <vector>
+
+struct FrameArena;
+struct JobSystem;
+
+// Grid of particle counts over a rectangular domain, accumulated over frames and color mapped for display.
+//
+// Every job thread splats into its own histogram, so splatting needs no atomics. The histograms are summed
+// into the grid by a parallel reduction over rows, which also applies the temporal decay and clears them.
+struct DensityGrid
+{
+	u32 width = 0;
+	u32 height = 0;
+
+	Vec2 domainMin = Vec2(0.0f);
+	Vec2 domainMax = Vec2(0.0f);
+
+	std::vector<float> density;
+
+	// One histogram per job thread, the last one is shared by foreign threads and guarded by a lock
+	std::vector<std::vector<u32>> threadCounts;
+	std::vector<u8> threadTouched;
+	std::mutex foreignThreadLock;
+
+	float maxDensity = 0.0f;
+
+	// Color mapped density, tightly packed RGBA8
+	std::vector<u32> pixels;
+};
+
+void createDensityGrid(DensityGrid& grid, u32 width, u32 height, const JobSystem* jobs);
+
+// Positions are in field coordinates, the grid covers [domainMin, domainMax] and positions outside are ignored.
+// Previous density is scaled by decay (0 shows only this frame). Changing the domain restarts the accumulation.
+void splatDensity(DensityGrid& grid, const Vec2* positions, u32 count, const Vec2& domainMin, const Vec2& domainMax,
+	float decay, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+
+// Writes pixels with a logarithmic color map, from black through red and yellow to white at the densest cell.
+void colorizeDensity(DensityGrid& grid, JobSystem* jobs = nullptr);
@@ -0,0 +1,210 @@
+#include "FlowerDerived.h"
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+#include <math.h>
+
+static constexpr u32 tilesPerJob = 4;
+
+struct DerivedRowMax
+{
+	float divergence = 0.0f;
+	float curl = 0.0f;
+	float magnitude = 0.0f;
+};
+
+// Cells in [x0, x1) must have both horizontal neighbors inside the row
+static void computeDerivedRow(const Vec2* __restrict row, const Vec2* __restrict rowUp, const Vec2* __restrict rowDown,
+	float* __restrict divergence, float* __restrict curl, float* __restrict magnitude, u32 x0, u32 x1, DerivedRowMax& rowMax)
+{
+	float maxDivergence = rowMax.divergence;
+	float maxCurl = rowMax.curl;
+	float maxMagnitude = rowMax.magnitude;
+
+	for (u32 x = x0; x < x1; ++x)
+	{
+		const float d = getDivergence(row[x - 1], row[x + 1], rowUp[x], rowDown[x]);
+		const float c = getCurl(row[x - 1], row[x + 1], rowUp[x], rowDown[x]);
+		const float m = sqrtf(row[x].x * row[x].x + row[x].y * row[x].y);
+
+		divergence[x] = d;
+		curl[x] = c;
+		magnitude[x] = m;
+
+		maxDivergence = max(maxDivergence, fabsf(d));
+		maxCurl = max(maxCurl, fabsf(c));
+		maxMagnitude = max(maxMagnitude, m);
+	}
+
+	rowMax.divergence = maxDivergence;
+	rowMax.curl = maxCurl;
+	rowMax.magnitude = maxMagnitude;
+}
+
+// Field edges use one sided neighbors, the same clamping as the field statistics
+static void computeDerivedEdgeCell(const Vec2* row, const Vec2* rowUp, const Vec2* rowDown, u32 width,
+	float* divergence, float* curl, float* magnitude, u32 x, DerivedRowMax& rowMax)
+{
+	const Vec2 left = row[x ? x - 1 : x];
+	const Vec2 right = row[min(x + 1, width - 1)];
+
+	divergence[x] = getDivergence(left, right, rowUp[x], rowDown[x]);
+	curl[x] = getCurl(left, right, rowUp[x], rowDown[x]);
+	magnitude[x] = row[x].length();
+
+	rowMax.divergence = max(rowMax.divergence, fabsf(divergence[x]));
+	rowMax.curl = max(rowMax.curl, fabsf(curl[x]));
+	rowMax.magnitude = max(rowMax.magnitude, magnitude[x]);
+}
+
+static void computeDerivedTile(FieldDerivedMaps& dm, const VectorField& vf, u32 tileIndex)
+{
+	const FieldRect rect = getTileRect(vf, tileIndex);
+
+	DerivedMap& divergenceMap = dm.maps[u32(FieldQuantity::Divergence)];
+	DerivedMap& curlMap = dm.maps[u32(FieldQuantity::Curl)];
+	DerivedMap& magnitudeMap = dm.maps[u32(FieldQuantity::Magnitude)];
+
+	const u32 interiorX0 = max(rect.x0, 1u);
+	const u32 interiorX1 = max(interiorX0, min(rect.x1, vf.width - 1));
+
+	DerivedRowMax tileMax;
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		const Vec2* row = vf.data + y * vf.width;
+		const Vec2* rowUp = vf.data + (y ? y - 1 : y) * vf.width;
+		const Vec2* rowDown = vf.data + min(y + 1, vf.height - 1) * vf.width;
+
+		float* divergence = divergenceMap.values.data() + y * vf.width;
+		float* curl = curlMap.values.data() + y * vf.width;
+		float* magnitude = magnitudeMap.values.data() + y * vf.width;
+
+		for (u32 x = rect.x0; x < interiorX0; ++x)
+		{
+			computeDerivedEdgeCell(row, rowUp, rowDown, vf.width, divergence, curl, magnitude, x, tileMax);
+		}
+
+		computeDerivedRow(row, rowUp, rowDown, divergence, curl, magnitude, interiorX0, interiorX1, tileMax);
+
+		for (u32 x = interiorX1; x < rect.x1; ++x)
+		{
+			computeDerivedEdgeCell(row, rowUp, rowDown, vf.width, divergence, curl, magnitude, x, tileMax);
+		}
+	}
+
+	divergenceMap.tileMaxAbs[tileIndex] = tileMax.divergence;
+	curlMap.tileMaxAbs[tileIndex] = tileMax.curl;
+	magnitudeMap.tileMaxAbs[tileIndex] = tileMax.magnitude;
+}
+
+u32 updateDerivedMaps(FieldDerivedMaps& dm, const VectorField& vf, JobSystem* jobs, FrameArena* arena)
+{
+	const u32 tileCount = u32(vf.tileRevisions.size());
+
+	if (dm.source.field != &vf || dm.width != vf.width || dm.height != vf.height)
+	{
+		resetFieldTileCache(dm.source, vf);
+		dm.width = vf.width;
+		dm.height = vf.height;
+		dm.revision = 0;
+		dm.tileRevisions.assign(tileCount, 0);
+
+		for (DerivedMap& map : dm.maps)
+		{
+			map.values.assign(vf.count, 0.0f);
+			map.tileMaxAbs.assign(tileCount, 0.0f);
+			map.pixels.assign(vf.count, 0xFF000000);
+			map.pixelRevisions.assign(tileCount, ~0u);
+			map.pixelRange = 0.0f;
+		}
+	}
+
+	// Differences at tile edges read the neighboring tiles, so changes spread to them
+	FrameArray<u32> dirtyTiles(arena, tileCount);
+	const u32 dirtyCount = collectDirtyTiles(dm.source, vf, 1, dirtyTiles.data);
+
+	if (!dirtyCount) return 0;
+
+	const u32 revision = ++dm.revision;
+
+	parallelFor(jobs, dirtyCount, tilesPerJob, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			computeDerivedTile(dm, vf, dirtyTiles[i]);
+			dm.tileRevisions[dirtyTiles[i]] = revision;
+		}
+	});
+
+	return dirtyCount;
+}
+
+float getDerivedMapMax(const FieldDerivedMaps& dm, FieldQuantity quantity)
+{
+	float result = 0.0f;
+	for (float tileMax : dm.maps[u32(quantity)].tileMaxAbs)
+	{
+		result = max(result, tileMax);
+	}
+	return result;
+}
+
+static inline u32 packColor(float r, float g, float b)
+{
+	return 0xFF000000 | (u32(b * 255.0f + 0.5f) << 16) | (u32(g * 255.0f + 0.5f) << 8) | u32(r * 255.0f + 0.5f);
+}
+
+bool updateDerivedImage(FieldDerivedMaps& dm, FieldQuantity quantity, float range, JobSystem* jobs, FrameArena* arena)
+{
+	DerivedMap& map = dm.maps[u32(quantity)];
+	const u32 tileCount = u32(dm.tileRevisions.size());
+
+	const bool recolorAll = map.pixelRange != range;
+	map.pixelRange = range;
+
+	FrameArray<u32> staleTiles(arena, tileCount);
+	u32 staleCount = 0;
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		if (recolorAll || map.pixelRevisions[tileIndex] != dm.tileRevisions[tileIndex]) staleTiles[staleCount++] = tileIndex;
+	}
+
+	if (!staleCount) return false;
+
+	const VectorField& vf = *dm.source.field;
+	const float scale = range > 0.0f ? 1.0f / range : 0.0f;
+	const bool isSigned = quantity != FieldQuantity::Magnitude;
+
+	parallelFor(jobs, staleCount, tilesPerJob, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u32 tileIndex = staleTiles[i];
+			const FieldRect rect = getTileRect(vf, tileIndex);
+
+			for (u32 y = rect.y0; y < rect.y1; ++y)
+			{
+				const float* values = map.values.data() + y * dm.width;
+				u32* out = map.pixels.data() + y * dm.width;
+
+				for (u32 x = rect.x0; x < rect.x1; ++x)
+				{
+					const float t = clamp(values[x] * scale, -1.0f, 1.0f);
+					if (isSigned)
+					{
+						out[x] = t > 0.0f ? packColor(t, 0.25f * t, 0.0f) : packColor(0.0f, -0.5f * t, -t);
+					}
+					else
+					{
+						out[x] = packColor(t, t, t);
+					}
+				}
+			}
+
+			map.pixelRevisions[tileIndex] = dm.tileRevisions[tileIndex];
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "FlowerField.h"
+
+#include <vector>
+
+struct FrameArena;
+
+enum class FieldQuantity : u32
+{
+	Divergence, // central differences, per cell
+	Curl,       // central differences, per cell
+	Magnitude,
+
+	Count
+};
+
+struct DerivedMap
+{
+	std::vector<float> values;
+	std::vector<float> tileMaxAbs;
+
+	// Color mapped values, tightly packed RGBA8. Tiles are only recolored when their values or the range changed.
+	std::vector<u32> pixels;
+	std::vector<u32> pixelRevisions;
+	float pixelRange = 0.0f;
+};
+
+// Scalar maps derived from a field, cached per tile. All quantities are computed together, so
+// switching between them only colors the tiles that changed since the quantity was last shown.
+struct FieldDerivedMaps
+{
+	FieldTileCache source;
+	u32 width = 0;
+	u32 height = 0;
+	u32 revision = 0;
+	std::vector<u32> tileRevisions;
+
+	DerivedMap maps[u32(FieldQuantity::Count)];
+};
+
+// Recomputes tiles changed in the field since the previous update, and their neighbors whose stencils reach into them.
+// Returns the number of tiles that were updated.
+u32 updateDerivedMaps(FieldDerivedMaps& dm, const VectorField& vf, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+
+// Largest absolute value of the quantity over the field
+float getDerivedMapMax(const FieldDerivedMaps& dm, FieldQuantity quantity);
+
+// Colors the quantity into its pixels: signed quantities from blue through black to red at -range and range,
+// magnitude from black to white at range. Returns true when any pixel changed.
+bool updateDerivedImage(FieldDerivedMaps& dm, FieldQuantity quantity, float range, JobSystem* jobs = nullptr,
+	FrameArena* arena = nullptr);
@@ -0,0 +1,224 @@
+#include "FlowerDistance.h"
+#include "FlowerJobs.h"
+
+#include <math.h>
+
+static constexpr u32 rowsPerJob = 16;
+
+// Bounds of the tiles that contain blocked cells, grown by margin cells
+static FieldRect getObstacleBounds(const ObstacleMask& mask, u32 margin)
+{
+	u32 tileX0 = mask.tileCountX, tileY0 = mask.tileCountY;
+	u32 tileX1 = 0, tileY1 = 0;
+
+	for (u32 tileY = 0; tileY < mask.tileCountY; ++tileY)
+	{
+		for (u32 tileX = 0; tileX < mask.tileCountX; ++tileX)
+		{
+			if (mask.tileStates[tileX + tileY * mask.tileCountX] == ObstacleTileState::Free) continue;
+
+			tileX0 = min(tileX0, tileX);
+			tileY0 = min(tileY0, tileY);
+			tileX1 = max(tileX1, tileX + 1);
+			tileY1 = max(tileY1, tileY + 1);
+		}
+	}
+
+	if (tileX0 >= tileX1) return FieldRect{0, 0, 0, 0};
+
+	const u32 tileSize = VectorField::tileSize;
+
+	FieldRect rect;
+	rect.x0 = tileX0 * tileSize > margin ? tileX0 * tileSize - margin : 0;
+	rect.y0 = tileY0 * tileSize > margin ? tileY0 * tileSize - margin : 0;
+	rect.x1 = min(mask.width, tileX1 * tileSize + margin);
+	rect.y1 = min(mask.height, tileY1 * tileSize + margin);
+	return rect;
+}
+
+// Keeps the closer of the current and the sampled seeds for cells [x0, x1) of row y.
+// The arrays never overlap, which lets the compiler vectorize without runtime alias checks.
+static void relaxRow(const s16* __restrict sampleX, const s16* __restrict sampleY, s32* __restrict best,
+	s16* __restrict outX, s16* __restrict outY, u32 x0, u32 x1, s32 y)
+{
+	for (u32 x = x0; x < x1; ++x)
+	{
+		const s32 cx = sampleX[x];
+		const s32 cy = sampleY[x];
+		const s32 dx = cx - s32(x);
+		const s32 dy = cy - y;
+		const s32 d = dx * dx + dy * dy;
+		const s32 bestD = best[x];
+		const s32 bestX = outX[x];
+		const s32 bestY = outY[x];
+		best[x] = d < bestD ? d : bestD;
+		outX[x] = s16(d < bestD ? cx : bestX);
+		outY[x] = s16(d < bestD ? cy : bestY);
+	}
+}
+
+// One jump flooding pass: every cell picks the nearest of the seeds found by itself and
+// by its 8 neighbors at the given step. Offsets are processed one at a time over whole rows,
+// which keeps the inner loop free of branches.
+static void floodPass(const FieldRect& rect, u32 width, u32 step,
+	const s16* srcX, const s16* srcY, s16* dstX, s16* dstY, JobSystem* jobs)
+{
+	const u32 rectWidth = rect.x1 - rect.x0;
+
+	parallelFor(jobs, rect.y1 - rect.y0, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		std::vector<s32> best(rectWidth);
+
+		for (u32 y = rect.y0 + rowBegin; y < rect.y0 + rowEnd; ++y)
+		{
+			const u32 rowOffset = y * width;
+			s16* outX = dstX + rowOffset;
+			s16* outY = dstY + rowOffset;
+
+			for (u32 x = rect.x0; x < rect.x1; ++x)
+			{
+				const s32 dx = s32(srcX[rowOffset + x]) - s32(x);
+				const s32 dy = s32(srcY[rowOffset + x]) - s32(y);
+				best[x - rect.x0] = dx * dx + dy * dy;
+				outX[x] = srcX[rowOffset + x];
+				outY[x] = srcY[rowOffset + x];
+			}
+
+			for (s32 offsetY = -1; offsetY <= 1; ++offsetY)
+			{
+				const s32 sampleY = s32(y) + offsetY * s32(step);
+				if (sampleY < s32(rect.y0) || sampleY >= s32(rect.y1)) continue;
+
+				for (s32 offsetX = -1; offsetX <= 1; ++offsetX)
+				{
+					if (offsetX == 0 && offsetY == 0) continue;
+
+					// Every sample would be outside of the rect, and the span below would wrap around
+					if (offsetX != 0 && step >= rectWidth) continue;
+
+					const s32 shift = offsetX * s32(step);
+					const u32 x0 = u32(max(s32(rect.x0), s32(rect.x0) - shift));
+					const u32 x1 = u32(min(s32(rect.x1), s32(rect.x1) - shift));
+
+					const s16* sampleX = srcX + u32(sampleY) * width + shift;
+					const s16* sampleYRow = srcY + u32(sampleY) * width + shift;
+					relaxRow(sampleX, sampleYRow, best.data() - rect.x0, outX, outY, x0, x1, s32(y));
+				}
+			}
+		}
+	});
+}
+
+FieldRect computeObstacleDistance(ObstacleDistanceField& df, const ObstacleMask& mask, u32 maxDistance, JobSystem* jobs)
+{
+	RUSH_ASSERT(mask.width < 8192 && mask.height < 8192);
+
+	const s16 noSeed = ObstacleDistanceField::noSeed;
+	const u32 cellCount = mask.width * mask.height;
+	if (df.width != mask.width || df.height != mask.height)
+	{
+		df.width = mask.width;
+		df.height = mask.height;
+		df.nearestX.assign(cellCount, noSeed);
+		df.nearestY.assign(cellCount, noSeed);
+		df.scratchX.assign(cellCount, noSeed);
+		df.scratchY.assign(cellCount, noSeed);
+	}
+
+	const FieldRect rect = getObstacleBounds(mask, maxDistance);
+	if (rect.empty()) return rect;
+
+	// Seeds travel up to twice the first step, the final extra pass at step 1 fixes most of the remaining errors.
+	// Steps that reach past the rect in both directions would only copy the buffers.
+	const u32 maxExtent = max(rect.x1 - rect.x0, rect.y1 - rect.y0);
+	u32 firstStep = 1;
+	while (firstStep * 2 < maxDistance && firstStep * 2 < maxExtent) firstStep *= 2;
+
+	std::vector<u32> steps;
+	for (u32 step = firstStep; step >= 1; step /= 2) steps.push_back(step);
+	steps.push_back(1);
+
+	// Passes alternate between the buffers, start from the one that makes the last pass write the nearest arrays
+	s16* bufferX[2] = { df.nearestX.data(), df.scratchX.data() };
+	s16* bufferY[2] = { df.nearestY.data(), df.scratchY.data() };
+	const u32 first = steps.size() % 2;
+
+	// Blocked cells are their own seeds
+	parallelFor(jobs, rect.y1 - rect.y0, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rect.y0 + rowBegin; y < rect.y0 + rowEnd; ++y)
+		{
+			s16* seedX = bufferX[first] + y * df.width;
+			s16* seedY = bufferY[first] + y * df.width;
+			for (u32 x = rect.x0; x < rect.x1; ++x)
+			{
+				const bool blocked = isBlocked(mask, x, y);
+				seedX[x] = blocked ? s16(x) : noSeed;
+				seedY[x] = blocked ? s16(y) : noSeed;
+			}
+		}
+	});
+
+	for (size_t i = 0; i < steps.size(); ++i)
+	{
+		const u32 src = (first + u32(i)) % 2;
+		floodPass(rect, df.width, steps[i], bufferX[src], bufferY[src], bufferX[src ^ 1], bufferY[src ^ 1], jobs);
+	}
+
+	return rect;
+}
+
+void applyObstacleFlow(VectorField& vf, ObstacleDistanceField& df, const ObstacleFlowSettings& settings, JobSystem* jobs)
+{
+	if (!vf.obstacles) return;
+
+	const ObstacleMask& mask = *vf.obstacles;
+	RUSH_ASSERT(mask.width == vf.width && mask.height == vf.height);
+
+	const float radius = max(1.0f, settings.radius * float(vf.width));
+	const FieldRect rect = computeObstacleDistance(df, mask, u32(ceilf(radius)) + 1, jobs);
+	if (rect.empty()) return;
+
+	const float invRadius = 1.0f / radius;
+	const float smallNumber = 0.00001f;
+
+	parallelFor(jobs, rect.y1 - rect.y0, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rect.y0 + rowBegin; y < rect.y0 + rowEnd; ++y)
+		{
+			const s16* nearestX = df.nearestX.data() + y * vf.width;
+			const s16* nearestY = df.nearestY.data() + y * vf.width;
+			Vec2* row = vf.data + y * vf.width;
+
+			forEachUnblockedSpan(vf, y, rect.x0, rect.x1, [&](u32 x0, u32 x1, u32 blockedBits)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					if (isBlockedBit(blockedBits, x)) continue;
+
+					const Vec2 away = Vec2(float(s32(x) - nearestX[x]), float(s32(y) - nearestY[x]));
+					const float distance = away.length();
+					if (distance - 1.0f >= radius) continue;
+
+					// Outline tangent, oriented along the existing flow
+					const Vec2 normal = away / distance;
+					Vec2 tangent = Vec2(-normal.y, normal.x);
+
+					const Vec2 v = row[x];
+					const float speed = v.length();
+					if (dot(v, tangent) < 0.0f) tangent = -tangent;
+
+					const Vec2 target = tangent * (speed > smallNumber ? speed : settings.speed);
+
+					// Cells next to the obstacle (distance 1) are fully tangential
+					const float t = clamp(1.0f - (distance - 1.0f) * invRadius, 0.0f, 1.0f);
+					const float weight = t * t * (3.0f - 2.0f * t);
+
+					row[x] = lerp(v, target, weight);
+				}
+			});
+		}
+	});
+
+	markFieldDirty(vf, rect);
+}
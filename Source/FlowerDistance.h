@@ -0,0 +1,40 @@
+#pragma once
+
+#include "FlowerField.h"
+
+#include <vector>
+
+// Nearest blocked cell for every cell around the obstacles, found with jump flooding.
+// Coordinates are stored per cell in separate arrays, cells without a nearby obstacle hold noSeed.
+struct ObstacleDistanceField
+{
+	static constexpr s16 noSeed = -16384;
+
+	u32 width = 0;
+	u32 height = 0;
+
+	std::vector<s16> nearestX;
+	std::vector<s16> nearestY;
+
+	// Ping-pong buffers for the flood passes
+	std::vector<s16> scratchX;
+	std::vector<s16> scratchY;
+};
+
+// Only cells within maxDistance cells of an obstacle are guaranteed to find their nearest blocked cell.
+// The work is limited to the obstacle bounds grown by maxDistance and to log2(maxDistance) + 2 passes.
+// Returns the rect of cells that were computed, empty when the mask has no obstacles.
+FieldRect computeObstacleDistance(ObstacleDistanceField& df, const ObstacleMask& mask, u32 maxDistance, JobSystem* jobs = nullptr);
+
+struct ObstacleFlowSettings
+{
+	// Distance from the obstacles where the flow is no longer affected, in normalized field coordinates (relative to width)
+	float radius = 0.05f;
+
+	// Length of the flow written where the field is empty
+	float speed = 0.5f;
+};
+
+// Bends the flow around the obstacles of the field (vf.obstacles) so it runs tangential to their outlines.
+// The existing flow picks the direction around each obstacle and keeps its length, the effect fades out over the radius.
+void applyObstacleFlow(VectorField& vf, ObstacleDistanceField& df, const ObstacleFlowSettings& settings, JobSystem* jobs = nullptr);
@@ -0,0 +1,1060 @@
+#include "FlowerField.h"
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+#include <string.h>
+
+VectorField::~VectorField()
+{
+	destroyVectorField(*this);
+}
+
+void createVectorField(VectorField& vf, u32 width, u32 height, Vec2* storage)
+{
+	destroyVectorField(vf);
+
+	vf.width  = width;
+	vf.height = height;
+	vf.count  = width * height;
+
+	if (storage)
+	{
+		vf.data = storage;
+		vf.ownsData = false;
+	}
+	else
+	{
+		vf.data = new Vec2[vf.count];
+		vf.ownsData = true;
+	}
+
+	vf.tileCountX = divUp(width, VectorField::tileSize);
+	vf.tileCountY = divUp(height, VectorField::tileSize);
+	vf.revision = 1;
+	vf.tileRevisions.assign(vf.tileCountX * vf.tileCountY, vf.revision);
+}
+
+void destroyVectorField(VectorField& vf)
+{
+	if (vf.ownsData)
+	{
+		delete[] vf.data;
+	}
+
+	vf.data = nullptr;
+	vf.ownsData = false;
+	vf.width = 0;
+	vf.height = 0;
+	vf.count = 0;
+	vf.tileCountX = 0;
+	vf.tileCountY = 0;
+	vf.tileRevisions.clear();
+}
+
+void initVectorField(VectorField& vf, const Vec2& value)
+{
+	for (u32 i = 0; i < vf.count; ++i)
+	{
+		vf.data[i] = value;
+	}
+
+	markFieldDirty(vf);
+}
+
+void markFieldDirty(VectorField& vf, const FieldRect& rect)
+{
+	if (rect.empty()) return;
+
+	const u32 revision = ++vf.revision;
+
+	const u32 tx0 = rect.x0 / VectorField::tileSize;
+	const u32 ty0 = rect.y0 / VectorField::tileSize;
+	const u32 tx1 = divUp(min(rect.x1, vf.width), VectorField::tileSize);
+	const u32 ty1 = divUp(min(rect.y1, vf.height), VectorField::tileSize);
+
+	for (u32 ty = ty0; ty < ty1; ++ty)
+	{
+		for (u32 tx = tx0; tx < tx1; ++tx)
+		{
+			vf.tileRevisions[tx + ty * vf.tileCountX] = revision;
+		}
+	}
+}
+
+void markFieldDirty(VectorField& vf)
+{
+	FieldRect rect = { 0, 0, vf.width, vf.height };
+	markFieldDirty(vf, rect);
+}
+
+FieldRect getTileRect(const VectorField& vf, u32 tileIndex)
+{
+	FieldRect rect;
+	rect.x0 = (tileIndex % vf.tileCountX) * VectorField::tileSize;
+	rect.y0 = (tileIndex / vf.tileCountX) * VectorField::tileSize;
+	rect.x1 = min(rect.x0 + VectorField::tileSize, vf.width);
+	rect.y1 = min(rect.y0 + VectorField::tileSize, vf.height);
+	return rect;
+}
+
+void resetFieldTileCache(FieldTileCache& cache, const VectorField& vf)
+{
+	cache.field = &vf;
+	cache.revisions.assign(vf.tileRevisions.size(), 0);
+}
+
+void flagDirtyTiles(FieldTileCache& cache, const VectorField& vf, u32 spread, u32* dirty)
+{
+	RUSH_ASSERT(cache.field == &vf && cache.revisions.size() == vf.tileRevisions.size());
+
+	for (u32 ty = 0; ty < vf.tileCountY; ++ty)
+	{
+		for (u32 tx = 0; tx < vf.tileCountX; ++tx)
+		{
+			const u32 tileIndex = tx + ty * vf.tileCountX;
+			if (cache.revisions[tileIndex] == vf.tileRevisions[tileIndex]) continue;
+
+			cache.revisions[tileIndex] = vf.tileRevisions[tileIndex];
+
+			const u32 ny1 = min(ty + spread, vf.tileCountY - 1);
+			const u32 nx1 = min(tx + spread, vf.tileCountX - 1);
+			for (u32 ny = ty - min(ty, spread); ny <= ny1; ++ny)
+			{
+				for (u32 nx = tx - min(tx, spread); nx <= nx1; ++nx)
+				{
+					dirty[nx + ny * vf.tileCountX] = 1;
+				}
+			}
+		}
+	}
+}
+
+u32 compactDirtyTiles(u32* dirty, u32 tileCount)
+{
+	// Indices are written at or before the flag being read, so later flags are intact when they are reached
+	u32 count = 0;
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		if (dirty[tileIndex]) dirty[count++] = tileIndex;
+	}
+	return count;
+}
+
+u32 collectDirtyTiles(FieldTileCache& cache, const VectorField& vf, u32 spread, u32* dirtyTiles)
+{
+	const u32 tileCount = u32(vf.tileRevisions.size());
+	memset(dirtyTiles, 0, sizeof(u32) * tileCount);
+	flagDirtyTiles(cache, vf, spread, dirtyTiles);
+	return compactDirtyTiles(dirtyTiles, tileCount);
+}
+
+FieldRect getRectTileBounds(const FieldRect& rect)
+{
+	FieldRect bounds;
+	bounds.x0 = rect.x0 / VectorField::tileSize;
+	bounds.y0 = rect.y0 / VectorField::tileSize;
+	bounds.x1 = divUp(rect.x1, VectorField::tileSize);
+	bounds.y1 = divUp(rect.y1, VectorField::tileSize);
+	return bounds;
+}
+
+u32 countTileBins(const VectorField& vf, const FieldRect* itemTileBounds, u32 itemCount, u32* offsets, u32* touchedTiles)
+{
+	const u32 tileCount = vf.tileCountX * vf.tileCountY;
+	memset(offsets, 0, sizeof(u32) * (tileCount + 1));
+
+	// Bounds are copied, so the counter stores can't alias the loop limits
+	for (u32 i = 0; i < itemCount; ++i)
+	{
+		const FieldRect bounds = itemTileBounds[i];
+		for (u32 ty = bounds.y0; ty < bounds.y1; ++ty)
+		{
+			u32* rowCounts = offsets + ty * vf.tileCountX + 1;
+			for (u32 tx = bounds.x0; tx < bounds.x1; ++tx)
+			{
+				rowCounts[tx]++;
+			}
+		}
+	}
+
+	u32 touchedCount = 0;
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		if (offsets[tileIndex + 1]) touchedTiles[touchedCount++] = tileIndex;
+		offsets[tileIndex + 1] += offsets[tileIndex];
+	}
+
+	return touchedCount;
+}
+
+void fillTileBins(const VectorField& vf, const FieldRect* itemTileBounds, u32 itemCount, u32* offsets, u32* items)
+{
+	// Offsets serve as fill cursors, which leaves each one at the start of the next tile
+	for (u32 i = 0; i < itemCount; ++i)
+	{
+		const FieldRect bounds = itemTileBounds[i];
+		for (u32 ty = bounds.y0; ty < bounds.y1; ++ty)
+		{
+			for (u32 tx = bounds.x0; tx < bounds.x1; ++tx)
+			{
+				items[offsets[tx + ty * vf.tileCountX]++] = i;
+			}
+		}
+	}
+
+	const u32 tileCount = vf.tileCountX * vf.tileCountY;
+	memmove(offsets + 1, offsets, sizeof(u32) * tileCount);
+	offsets[0] = 0;
+}
+
+static_assert(VectorField::tileSize == 32, "Obstacle mask words cover one row of a tile");
+
+void createObstacleMask(ObstacleMask& mask, u32 width, u32 height)
+{
+	mask.width = width;
+	mask.height = height;
+	mask.wordsPerRow = divUp(width, VectorField::tileSize);
+	mask.tileCountX = mask.wordsPerRow;
+	mask.tileCountY = divUp(height, VectorField::tileSize);
+	mask.bits.assign(mask.wordsPerRow * height, 0);
+	mask.tileStates.assign(mask.tileCountX * mask.tileCountY, ObstacleTileState::Free);
+}
+
+static void updateObstacleTileState(ObstacleMask& mask, u32 tileX, u32 tileY)
+{
+	const u32 x0 = tileX * VectorField::tileSize;
+	const u32 y0 = tileY * VectorField::tileSize;
+	const u32 y1 = min(y0 + VectorField::tileSize, mask.height);
+	const u32 columnCount = min(VectorField::tileSize, mask.width - x0);
+	const u32 fullRow = columnCount == 32 ? ~0u : (1u << columnCount) - 1;
+
+	u32 anyBlocked = 0;
+	u32 allBlocked = fullRow;
+	for (u32 y = y0; y < y1; ++y)
+	{
+		const u32 word = getObstacleBits(mask, tileX, y) & fullRow;
+		anyBlocked |= word;
+		allBlocked &= word;
+	}
+
+	ObstacleTileState& state = mask.tileStates[tileX + tileY * mask.tileCountX];
+	if (!anyBlocked)
+	{
+		state = ObstacleTileState::Free;
+	}
+	else if (allBlocked == fullRow)
+	{
+		state = ObstacleTileState::Blocked;
+	}
+	else
+	{
+		state = ObstacleTileState::Mixed;
+	}
+}
+
+void paintObstacles(ObstacleMask& mask, const Vec2& pos, float radius, bool blocked)
+{
+	const float x0 = clamp(floorf((pos.x - radius) * mask.width), 0.0f, float(mask.width));
+	const float y0 = clamp(floorf((pos.y - radius) * mask.height), 0.0f, float(mask.height));
+	const float x1 = clamp(ceilf((pos.x + radius) * mask.width) + 1.0f, 0.0f, float(mask.width));
+	const float y1 = clamp(ceilf((pos.y + radius) * mask.height) + 1.0f, 0.0f, float(mask.height));
+
+	FieldRect rect = { u32(x0), u32(y0), u32(x1), u32(y1) };
+	if (rect.empty()) return;
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			Vec2 p = Vec2((float)x, (float)y) / Vec2((float)mask.width, (float)mask.height);
+			if ((p - pos).length() > radius) continue;
+
+			u32& word = mask.bits[x / 32 + y * mask.wordsPerRow];
+			const u32 bit = 1u << (x % 32);
+			word = blocked ? word | bit : word & ~bit;
+		}
+	}
+
+	for (u32 ty = rect.y0 / VectorField::tileSize; ty < divUp(rect.y1, VectorField::tileSize); ++ty)
+	{
+		for (u32 tx = rect.x0 / VectorField::tileSize; tx < divUp(rect.x1, VectorField::tileSize); ++tx)
+		{
+			updateObstacleTileState(mask, tx, ty);
+		}
+	}
+
+	mask.revision++;
+}
+
+void downsampleObstacleMask(ObstacleMask& dst, const ObstacleMask& src)
+{
+	createObstacleMask(dst, divUp(src.width, 2u), divUp(src.height, 2u));
+
+	for (u32 y = 0; y < dst.height; ++y)
+	{
+		const u32 y0 = y * 2;
+		const u32 y1 = min(y0 + 1, src.height - 1);
+
+		for (u32 x = 0; x < dst.width; ++x)
+		{
+			const u32 x0 = x * 2;
+			const u32 x1 = min(x0 + 1, src.width - 1);
+
+			if (isBlocked(src, x0, y0) || isBlocked(src, x1, y0) || isBlocked(src, x0, y1) || isBlocked(src, x1, y1))
+			{
+				dst.bits[x / 32 + y * dst.wordsPerRow] |= 1u << (x % 32);
+			}
+		}
+	}
+
+	for (u32 ty = 0; ty < dst.tileCountY; ++ty)
+	{
+		for (u32 tx = 0; tx < dst.tileCountX; ++tx)
+		{
+			updateObstacleTileState(dst, tx, ty);
+		}
+	}
+
+	dst.revision = src.revision;
+}
+
+const Vec2& sample(const VectorField& vf, const Vec2& uv)
+{
+	u32 ix = (u32)(uv.x*vf.width) % vf.width;
+	u32 iy = (u32)(uv.y*vf.height) % vf.height;
+	return vf.data[ix + iy * vf.width];
+}
+
+FieldRect getBrushRect(const VectorField& vf, const Vec2& brushPos, float brushRadius)
+{
+	// Conservative by one cell on each side, exact coverage is decided per cell by the brush
+	const float x0 = floorf((brushPos.x - brushRadius) * vf.width) - 1.0f;
+	const float y0 = floorf((brushPos.y - brushRadius) * vf.height) - 1.0f;
+	const float x1 = floorf((brushPos.x + brushRadius) * vf.width) + 2.0f;
+	const float y1 = floorf((brushPos.y + brushRadius) * vf.height) + 2.0f;
+
+	FieldRect rect;
+	rect.x0 = u32(clamp(x0, 0.0f, float(vf.width)));
+	rect.y0 = u32(clamp(y0, 0.0f, float(vf.height)));
+	rect.x1 = u32(clamp(x1, 0.0f, float(vf.width)));
+	rect.y1 = u32(clamp(y1, 0.0f, float(vf.height)));
+
+	return rect;
+}
+
+static bool isValidBrushPosition(const Vec2& pos)
+{
+	return pos.x >= -maxBrushRadius && pos.x <= 1.0f + maxBrushRadius &&
+		pos.y >= -maxBrushRadius && pos.y <= 1.0f + maxBrushRadius;
+}
+
+bool isValidBrushStroke(const BrushStroke& s)
+{
+	return s.tool <= BrushTool::Dampen && s.radius >= minBrushRadius && s.radius <= maxBrushRadius &&
+		isValidBrushPosition(s.prev) && isValidBrushPosition(s.cur);
+}
+
+static constexpr u32 rowsPerJob = 16;
+
+// Brush parameters that only depend on the stroke, computed once per dab
+struct BrushDab
+{
+	BrushTool tool;
+	Vec2 pos;
+	float radius;
+	Vec2 strokeDir;
+	float strokeWeight;
+	FieldRect rect;
+};
+
+static bool makeBrushDab(const VectorField& vf, const BrushStroke& s, BrushDab& dab)
+{
+	dab.tool = s.tool;
+	dab.pos = s.cur;
+	dab.radius = s.radius;
+	dab.strokeDir = Vec2(0.0f);
+	dab.strokeWeight = 0.0f;
+
+	if (s.tool == BrushTool::Comb)
+	{
+		Vec2 stroke = s.cur - s.prev;
+		float strokeLength = stroke.length();
+
+		const float strokeThreshold = 0.0001f;
+		if (strokeLength <= strokeThreshold) return false;
+
+		dab.strokeWeight = pow(strokeLength, 1.8f);
+		dab.strokeDir = stroke / strokeLength;
+	}
+
+	dab.rect = getBrushRect(vf, s.cur, s.radius);
+	return !dab.rect.empty();
+}
+
+// Row span brush kernels. Cells outside the brush square or blocked by obstacles keep their value.
+
+static void dampenSpan(VectorField& vf, const BrushDab& dab, u32 y, u32 x0, u32 x1, u32 blockedBits)
+{
+	const float absDeltaY = fabsf(float(y) / float(vf.height) - dab.pos.y);
+	if (absDeltaY > dab.radius) return;
+
+	const float invWidth = 1.0f / float(vf.width);
+	const float invRadius = 1.0f / dab.radius;
+	const float forceY = absDeltaY * invRadius;
+
+	Vec2* row = vf.data + y * vf.width;
+	for (u32 x = x0; x < x1; ++x)
+	{
+		const float absDeltaX = fabsf(float(x) * invWidth - dab.pos.x);
+		const float forceX = absDeltaX * invRadius;
+		const float forceLen = min(1.0f, sqrtf(forceX * forceX + forceY * forceY));
+
+		// lerp(v * 0.8, v, forceLen)
+		const float scale = 0.8f + 0.2f * forceLen;
+
+		const bool apply = (absDeltaX <= dab.radius) & !isBlockedBit(blockedBits, x);
+		row[x] *= apply ? scale : 1.0f;
+	}
+}
+
+static void combSpan(VectorField& vf, const BrushDab& dab, u32 y, u32 x0, u32 x1, u32 blockedBits)
+{
+	const float absDeltaY = fabsf(float(y) / float(vf.height) - dab.pos.y);
+	if (absDeltaY > dab.radius) return;
+
+	const float invWidth = 1.0f / float(vf.width);
+	const float invRadius = 1.0f / dab.radius;
+	const float forceY = absDeltaY * invRadius;
+	const Vec2 strokeForce = dab.strokeDir * (dab.strokeWeight * (150.0f / (4.0f * dab.radius)));
+
+	Vec2* row = vf.data + y * vf.width;
+	for (u32 x = x0; x < x1; ++x)
+	{
+		const float absDeltaX = fabsf(float(x) * invWidth - dab.pos.x);
+		const float forceX = absDeltaX * invRadius;
+		const float forceLen = min(1.0f, sqrtf(forceX * forceX + forceY * forceY));
+
+		const Vec2 v = row[x];
+		const Vec2 result = v + strokeForce * (1.0f - forceLen);
+
+		// Clamp to unit length
+		const float resultScale = 1.0f / max(1.0f, result.length());
+
+		const bool apply = (absDeltaX <= dab.radius) & !isBlockedBit(blockedBits, x);
+		row[x] = apply ? result * resultScale : v;
+	}
+}
+
+// Applies the dab to rows [y0, y1) of its rect, limited to columns [x0, x1)
+static void applyBrushDab(VectorField& vf, const BrushDab& dab, u32 x0, u32 y0, u32 x1, u32 y1)
+{
+	for (u32 y = y0; y < y1; ++y)
+	{
+		forEachUnblockedSpan(vf, y, x0, x1, [&](u32 spanX0, u32 spanX1, u32 blockedBits)
+		{
+			switch (dab.tool)
+			{
+			case BrushTool::Comb:   combSpan(vf, dab, y, spanX0, spanX1, blockedBits); break;
+			case BrushTool::Dampen: dampenSpan(vf, dab, y, spanX0, spanX1, blockedBits); break;
+			}
+		});
+	}
+}
+
+static void applyBrushDab(VectorField& vf, const BrushDab& dab, JobSystem* jobs)
+{
+	const FieldRect& rect = dab.rect;
+
+	markFieldDirty(vf, rect);
+
+	parallelFor(jobs, rect.y1 - rect.y0, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		applyBrushDab(vf, dab, rect.x0, rect.y0 + rowBegin, rect.x1, rect.y0 + rowEnd);
+	});
+}
+
+void dampen(VectorField& vf, const Vec2& brushPos, float brushRadius, JobSystem* jobs)
+{
+	const BrushStroke stroke = { BrushTool::Dampen, brushPos, brushPos, brushRadius };
+
+	BrushDab dab;
+	if (makeBrushDab(vf, stroke, dab)) applyBrushDab(vf, dab, jobs);
+}
+
+void comb(VectorField& vf, const Vec2& brushPrev, const Vec2& brushCur, float brushRadius, JobSystem* jobs)
+{
+	const BrushStroke stroke = { BrushTool::Comb, brushPrev, brushCur, brushRadius };
+
+	BrushDab dab;
+	if (makeBrushDab(vf, stroke, dab)) applyBrushDab(vf, dab, jobs);
+}
+
+void applyStrokes(VectorField& vf, const BrushStroke* strokes, u32 strokeCount, JobSystem* jobs, FrameArena* arena)
+{
+	FrameArray<BrushDab> dabs(arena, strokeCount);
+	u32 dabCount = 0;
+	for (u32 i = 0; i < strokeCount; ++i)
+	{
+		if (makeBrushDab(vf, strokes[i], dabs[dabCount])) dabCount++;
+	}
+
+	if (!dabCount) return;
+
+	// A single dab has nothing to share, its rows are spread over the jobs instead of its tiles
+	if (dabCount == 1)
+	{
+		applyBrushDab(vf, dabs[0], jobs);
+		return;
+	}
+
+	// Bin dabs into the tiles they overlap, keeping them in stroke order within each tile.
+	// Every cell only depends on its own value and the dab, so applying a tile's dabs in order matches applying
+	// the strokes one by one, while the tile stays in cache and tiles can be processed in parallel.
+	const u32 tileCount = vf.tileCountX * vf.tileCountY;
+	FrameArray<FieldRect> dabTileBounds(arena, dabCount);
+	for (u32 i = 0; i < dabCount; ++i)
+	{
+		dabTileBounds[i] = getRectTileBounds(dabs[i].rect);
+	}
+
+	FrameArray<u32> tileDabOffsets(arena, tileCount + 1);
+	FrameArray<u32> touchedTiles(arena, tileCount);
+	const u32 touchedCount = countTileBins(vf, dabTileBounds.data, dabCount, tileDabOffsets.data, touchedTiles.data);
+
+	FrameArray<u32> tileDabs(arena, tileDabOffsets[tileCount]);
+	fillTileBins(vf, dabTileBounds.data, dabCount, tileDabOffsets.data, tileDabs.data);
+
+	parallelFor(jobs, touchedCount, 1, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u32 tileIndex = touchedTiles[i];
+			const FieldRect tile = getTileRect(vf, tileIndex);
+
+			for (u32 j = tileDabOffsets[tileIndex]; j < tileDabOffsets[tileIndex + 1]; ++j)
+			{
+				const BrushDab& dab = dabs[tileDabs[j]];
+				applyBrushDab(vf, dab,
+					max(dab.rect.x0, tile.x0), max(dab.rect.y0, tile.y0),
+					min(dab.rect.x1, tile.x1), min(dab.rect.y1, tile.y1));
+			}
+		}
+	});
+
+	for (u32 i = 0; i < touchedCount; ++i)
+	{
+		markFieldDirty(vf, getTileRect(vf, touchedTiles[i]));
+	}
+}
+
+static void smoothField(VectorField& vf, u32 radius, JobSystem* jobs)
+{
+	if (radius == 0) return;
+
+	std::vector<Vec2> scratch(vf.count);
+
+	const float weight = 1.0f / float(2 * radius + 1);
+	const int r = int(radius);
+
+	// Separable box blur with clamped edges: horizontal pass into scratch, vertical pass back into the field.
+
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			const Vec2* row = vf.data + y * vf.width;
+			for (u32 x = 0; x < vf.width; ++x)
+			{
+				Vec2 sum = Vec2(0.0f);
+				for (int k = -r; k <= r; ++k)
+				{
+					int sx = clamp(int(x) + k, 0, int(vf.width) - 1);
+					sum += row[sx];
+				}
+				scratch[x + y * vf.width] = sum * weight;
+			}
+		}
+	});
+
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			forEachUnblockedSpan(vf, y, 0, vf.width, [&](u32 x0, u32 x1, u32 blockedBits)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					Vec2 sum = Vec2(0.0f);
+					for (int k = -r; k <= r; ++k)
+					{
+						int sy = clamp(int(y) + k, 0, int(vf.height) - 1);
+						sum += scratch[x + sy * vf.width];
+					}
+					Vec2& v = vf.data[x + y * vf.width];
+					v = isBlockedBit(blockedBits, x) ? v : sum * weight;
+				}
+			});
+		}
+	});
+}
+
+static void normalizeField(VectorField& vf, JobSystem* jobs)
+{
+	static constexpr float smallNumber = 0.00001f;
+
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			forEachUnblockedSpan(vf, y, 0, vf.width, [&](u32 x0, u32 x1, u32 blockedBits)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					Vec2& v = vf.data[x + y * vf.width];
+					float vLength = v.length();
+					if (vLength > smallNumber && !isBlockedBit(blockedBits, x))
+					{
+						v /= vLength;
+					}
+				}
+			});
+		}
+	});
+}
+
+void applyFilter(VectorField& vf, FieldFilter filter, u32 param, JobSystem* jobs)
+{
+	switch (filter)
+	{
+	case FieldFilter::Smooth:    smoothField(vf, param, jobs); break;
+	case FieldFilter::Normalize: normalizeField(vf, jobs); break;
+	}
+
+	markFieldDirty(vf);
+}
+
+template <FieldTransform transform>
+static inline Vec2 transformVector(const Vec2& v)
+{
+	switch (transform)
+	{
+	case FieldTransform::Rotate90:  return Vec2(-v.y, v.x);
+	case FieldTransform::Rotate180: return Vec2(-v.x, -v.y);
+	case FieldTransform::Rotate270: return Vec2(v.y, -v.x);
+	case FieldTransform::FlipX:     return Vec2(-v.x, v.y);
+	case FieldTransform::FlipY:     return Vec2(v.x, -v.y);
+	case FieldTransform::Transpose: return Vec2(v.y, v.x);
+	}
+	return v;
+}
+
+// Exchanges rows a and b (which may be the same row), reversing them when mirroring left to right
+template <FieldTransform transform>
+static void transformRowPair(Vec2* a, Vec2* b, u32 width, bool reverse)
+{
+	if (a == b && !reverse)
+	{
+		for (u32 x = 0; x < width; ++x) a[x] = transformVector<transform>(a[x]);
+		return;
+	}
+
+	const u32 count = a == b ? divUp(width, 2u) : width;
+	for (u32 x = 0; x < count; ++x)
+	{
+		const u32 other = reverse ? width - 1 - x : x;
+		const Vec2 temp = a[x];
+		a[x] = transformVector<transform>(b[other]);
+		b[other] = transformVector<transform>(temp);
+	}
+}
+
+template <FieldTransform transform>
+static void mirrorField(VectorField& vf, JobSystem* jobs)
+{
+	const bool reverse = transform != FieldTransform::FlipY;
+	const bool swapRows = transform != FieldTransform::FlipX;
+	const u32 pairCount = swapRows ? divUp(vf.height, 2u) : vf.height;
+
+	parallelFor(jobs, pairCount, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			Vec2* a = vf.data + y * vf.width;
+			Vec2* b = swapRows ? vf.data + (vf.height - 1 - y) * vf.width : a;
+			transformRowPair<transform>(a, b, vf.width, reverse);
+		}
+	});
+}
+
+// Square blocks moved at once by the dimension swapping transforms. Larger than field tiles, so each contiguous
+// run of a row spans several cache lines and fewer pages are touched per block.
+static constexpr u32 transformBlockSize = 64;
+
+// Cells [x0, x1) x [y0, y1) of a field with the given dimensions end up in the returned rect
+template <FieldTransform transform>
+static FieldRect getTransformedRect(const FieldRect& rect, u32 width, u32 height)
+{
+	switch (transform)
+	{
+	case FieldTransform::Rotate90:  return FieldRect{ height - rect.y1, rect.x0, height - rect.y0, rect.x1 };
+	case FieldTransform::Rotate270: return FieldRect{ rect.y0, width - rect.x1, rect.y1, width - rect.x0 };
+	default:                        return FieldRect{ rect.y0, rect.x0, rect.y1, rect.x1 };
+	}
+}
+
+// Moves the cells of every block to its transformed rect. All blocks are copied to the scratch buffer before
+// anything is written, so a set of blocks that maps onto itself is transformed in place.
+// Field rows are only ever read and written in contiguous runs, columns are walked in the scratch buffer.
+// With power of two field widths, walking columns of the field directly maps every access to the same cache set.
+template <FieldTransform transform>
+static void transformBlocks(const Vec2* src, Vec2* dst, u32 srcWidth, u32 srcHeight, const FieldRect* rects, u32 rectCount, Vec2* scratch)
+{
+	static constexpr u32 blockCellCount = transformBlockSize * transformBlockSize;
+	RUSH_ASSERT(rectCount <= 4);
+
+	for (u32 i = 0; i < rectCount; ++i)
+	{
+		const FieldRect& rect = rects[i];
+		const u32 rectWidth = rect.x1 - rect.x0;
+		for (u32 y = rect.y0; y < rect.y1; ++y)
+		{
+			memcpy(&scratch[i * blockCellCount + (y - rect.y0) * rectWidth], src + rect.x0 + y * srcWidth, sizeof(Vec2) * rectWidth);
+		}
+	}
+
+	const u32 dstWidth = srcHeight;
+
+	for (u32 i = 0; i < rectCount; ++i)
+	{
+		const FieldRect& rect = rects[i];
+		const FieldRect dstRect = getTransformedRect<transform>(rect, srcWidth, srcHeight);
+		const u32 rectWidth = rect.x1 - rect.x0;
+
+		for (u32 y = dstRect.y0; y < dstRect.y1; ++y)
+		{
+			Vec2* out = dst + y * dstWidth;
+			for (u32 x = dstRect.x0; x < dstRect.x1; ++x)
+			{
+				// Source cell of the destination cell
+				u32 srcX = y, srcY = x;
+				if (transform == FieldTransform::Rotate90) srcY = srcHeight - 1 - x;
+				if (transform == FieldTransform::Rotate270) srcX = srcWidth - 1 - y;
+
+				out[x] = transformVector<transform>(scratch[i * blockCellCount + (srcX - rect.x0) + (srcY - rect.y0) * rectWidth]);
+			}
+		}
+	}
+}
+
+// In place transpose of a square field. Blocks above the diagonal are exchanged with their mirror blocks.
+static void transposeSquareField(VectorField& vf, JobSystem* jobs)
+{
+	const u32 n = vf.width;
+	const u32 blockSize = transformBlockSize;
+	const u32 blockCount = divUp(n, blockSize);
+
+	parallelFor(jobs, blockCount, 1, [&](u32 blockBegin, u32 blockEnd)
+	{
+		std::vector<Vec2> scratch(2 * blockSize * blockSize);
+
+		for (u32 blockY = blockBegin; blockY < blockEnd; ++blockY)
+		{
+			for (u32 blockX = blockY; blockX < blockCount; ++blockX)
+			{
+				FieldRect rects[2];
+				rects[0] = { blockX * blockSize, blockY * blockSize, min((blockX + 1) * blockSize, n), min((blockY + 1) * blockSize, n) };
+				rects[1] = getTransformedRect<FieldTransform::Transpose>(rects[0], n, n);
+				transformBlocks<FieldTransform::Transpose>(vf.data, vf.data, n, n, rects, blockX == blockY ? 1 : 2, scratch.data());
+			}
+		}
+	});
+}
+
+// In place quarter turn of a square field. Every block of the top left quadrant starts a cycle of four blocks.
+template <FieldTransform transform>
+static void rotateSquareField(VectorField& vf, JobSystem* jobs)
+{
+	const u32 n = vf.width;
+	const u32 blockSize = transformBlockSize;
+	const u32 quadrantWidth = divUp(n, 2u);
+	const u32 quadrantHeight = n / 2;
+
+	parallelFor(jobs, divUp(quadrantHeight, blockSize), 1, [&](u32 blockBegin, u32 blockEnd)
+	{
+		std::vector<Vec2> scratch(4 * blockSize * blockSize);
+
+		for (u32 blockY = blockBegin; blockY < blockEnd; ++blockY)
+		{
+			for (u32 x0 = 0; x0 < quadrantWidth; x0 += blockSize)
+			{
+				const u32 y0 = blockY * blockSize;
+
+				FieldRect rects[4];
+				rects[0] = { x0, y0, min(x0 + blockSize, quadrantWidth), min(y0 + blockSize, quadrantHeight) };
+				for (u32 i = 1; i < 4; ++i)
+				{
+					rects[i] = getTransformedRect<FieldTransform::Rotate90>(rects[i - 1], n, n);
+				}
+				transformBlocks<transform>(vf.data, vf.data, n, n, rects, 4, scratch.data());
+			}
+		}
+	});
+
+	if (n % 2)
+	{
+		Vec2& center = vf.data[(n / 2) + (n / 2) * n];
+		center = transformVector<transform>(center);
+	}
+}
+
+// Transforms that swap the dimensions of a non-square field go through a temporary copy
+template <FieldTransform transform>
+static void rotateRectangularField(VectorField& vf, JobSystem* jobs)
+{
+	const u32 blockSize = transformBlockSize;
+	const u32 blockCountX = divUp(vf.width, blockSize);
+
+	Vec2* result = new Vec2[vf.count];
+
+	parallelFor(jobs, divUp(vf.height, blockSize), 1, [&](u32 blockBegin, u32 blockEnd)
+	{
+		std::vector<Vec2> scratch(blockSize * blockSize);
+
+		for (u32 blockY = blockBegin; blockY < blockEnd; ++blockY)
+		{
+			for (u32 blockX = 0; blockX < blockCountX; ++blockX)
+			{
+				const FieldRect rect = { blockX * blockSize, blockY * blockSize,
+					min((blockX + 1) * blockSize, vf.width), min((blockY + 1) * blockSize, vf.height) };
+				transformBlocks<transform>(vf.data, result, vf.width, vf.height, &rect, 1, scratch.data());
+			}
+		}
+	});
+
+	if (vf.ownsData)
+	{
+		delete[] vf.data;
+		vf.data = result;
+	}
+	else
+	{
+		memcpy(vf.data, result, sizeof(Vec2) * vf.count);
+		delete[] result;
+	}
+
+	std::swap(vf.width, vf.height);
+	vf.tileCountX = divUp(vf.width, VectorField::tileSize);
+	vf.tileCountY = divUp(vf.height, VectorField::tileSize);
+	vf.tileRevisions.assign(vf.tileCountX * vf.tileCountY, vf.revision);
+}
+
+template <FieldTransform transform>
+static void transposeOrRotateField(VectorField& vf, JobSystem* jobs)
+{
+	if (vf.width != vf.height)
+	{
+		rotateRectangularField<transform>(vf, jobs);
+	}
+	else if (transform == FieldTransform::Transpose)
+	{
+		transposeSquareField(vf, jobs);
+	}
+	else
+	{
+		rotateSquareField<transform>(vf, jobs);
+	}
+}
+
+// Copies of the tiles that contain blocked cells, taken before a transform moves the cells
+struct BlockedTileValues
+{
+	std::vector<u32> tiles;
+	std::vector<Vec2> values; // tileSize * tileSize cells per tile, row by row
+};
+
+static void saveBlockedTiles(BlockedTileValues& saved, const VectorField& vf)
+{
+	static constexpr u32 tileSize = VectorField::tileSize;
+
+	for (u32 tileIndex = 0; tileIndex < vf.tileCountX * vf.tileCountY; ++tileIndex)
+	{
+		if (getObstacleTileState(vf.obstacles, tileIndex % vf.tileCountX, tileIndex / vf.tileCountX) != ObstacleTileState::Free)
+		{
+			saved.tiles.push_back(tileIndex);
+		}
+	}
+
+	saved.values.resize(saved.tiles.size() * tileSize * tileSize);
+	for (u32 i = 0; i < u32(saved.tiles.size()); ++i)
+	{
+		const FieldRect rect = getTileRect(vf, saved.tiles[i]);
+		for (u32 y = rect.y0; y < rect.y1; ++y)
+		{
+			memcpy(&saved.values[(i * tileSize + y - rect.y0) * tileSize], vf.data + rect.x0 + y * vf.width,
+				sizeof(Vec2) * (rect.x1 - rect.x0));
+		}
+	}
+}
+
+static void restoreBlockedCells(VectorField& vf, const BlockedTileValues& saved, JobSystem* jobs)
+{
+	static constexpr u32 tileSize = VectorField::tileSize;
+	const ObstacleMask& mask = *vf.obstacles;
+
+	parallelFor(jobs, u32(saved.tiles.size()), 4, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u32 tileX = saved.tiles[i] % vf.tileCountX;
+			const FieldRect rect = getTileRect(vf, saved.tiles[i]);
+			for (u32 y = rect.y0; y < rect.y1; ++y)
+			{
+				const u32 blockedBits = getObstacleBits(mask, tileX, y);
+				const Vec2* values = &saved.values[(i * tileSize + y - rect.y0) * tileSize];
+				Vec2* out = vf.data + y * vf.width;
+				for (u32 x = rect.x0; x < rect.x1; ++x)
+				{
+					if (isBlockedBit(blockedBits, x)) out[x] = values[x - rect.x0];
+				}
+			}
+		}
+	});
+}
+
+bool transformField(VectorField& vf, FieldTransform transform, JobSystem* jobs)
+{
+	const bool swapsDimensions = vf.width != vf.height &&
+		(transform == FieldTransform::Rotate90 || transform == FieldTransform::Rotate270 || transform == FieldTransform::Transpose);
+	if (swapsDimensions && vf.obstacles) return false;
+
+	BlockedTileValues blocked;
+	if (vf.obstacles)
+	{
+		RUSH_ASSERT(vf.obstacles->width == vf.width && vf.obstacles->height == vf.height);
+		saveBlockedTiles(blocked, vf);
+	}
+
+	switch (transform)
+	{
+	case FieldTransform::Rotate90:  transposeOrRotateField<FieldTransform::Rotate90>(vf, jobs); break;
+	case FieldTransform::Rotate180: mirrorField<FieldTransform::Rotate180>(vf, jobs); break;
+	case FieldTransform::Rotate270: transposeOrRotateField<FieldTransform::Rotate270>(vf, jobs); break;
+	case FieldTransform::FlipX:     mirrorField<FieldTransform::FlipX>(vf, jobs); break;
+	case FieldTransform::FlipY:     mirrorField<FieldTransform::FlipY>(vf, jobs); break;
+	case FieldTransform::Transpose: transposeOrRotateField<FieldTransform::Transpose>(vf, jobs); break;
+	}
+
+	if (!blocked.tiles.empty())
+	{
+		restoreBlockedCells(vf, blocked, jobs);
+	}
+
+	markFieldDirty(vf);
+	return true;
+}
+
+static void downsampleField(VectorField& dst, const VectorField& src, const FieldRect& rect)
+{
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		const Vec2* row0 = src.data + min(y * 2 + 0, src.height - 1) * src.width;
+		const Vec2* row1 = src.data + min(y * 2 + 1, src.height - 1) * src.width;
+		Vec2* out = dst.data + y * dst.width;
+
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			const u32 x0 = min(x * 2 + 0, src.width - 1);
+			const u32 x1 = min(x * 2 + 1, src.width - 1);
+			out[x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1]) * 0.25f;
+		}
+	}
+}
+
+void updateFieldMipChain(FieldMipChain& chain, const VectorField& vf, JobSystem* jobs, FrameArena* arena)
+{
+	const bool rebuild = chain.source.field != &vf || chain.source.revisions.size() != vf.tileRevisions.size() ||
+		chain.levels.empty() || chain.levels[0]->width != divUp(vf.width, 2u) || chain.levels[0]->height != divUp(vf.height, 2u);
+
+	if (rebuild)
+	{
+		resetFieldTileCache(chain.source, vf);
+		chain.levels.clear();
+
+		u32 width = vf.width;
+		u32 height = vf.height;
+		while (width > 1 || height > 1)
+		{
+			width = divUp(width, 2u);
+			height = divUp(height, 2u);
+			chain.levels.emplace_back(new VectorField);
+			createVectorField(*chain.levels.back(), width, height);
+		}
+	}
+
+	FrameArray<u32> dirtyTiles(arena, u32(vf.tileRevisions.size()));
+	const u32 dirtyCount = collectDirtyTiles(chain.source, vf, 0, dirtyTiles.data);
+
+	if (!dirtyCount) return;
+
+	// Each level is built from the previous one. Footprints of source tiles in a level are disjoint
+	// until a tile shrinks below a cell, the few remaining coarse levels are rebuilt entirely.
+	for (u32 levelIndex = 0; levelIndex < u32(chain.levels.size()); ++levelIndex)
+	{
+		VectorField& dst = *chain.levels[levelIndex];
+		const VectorField& src = levelIndex ? *chain.levels[levelIndex - 1] : vf;
+		const u32 shift = levelIndex + 1;
+
+		if ((VectorField::tileSize >> shift) == 0)
+		{
+			FieldRect rect = { 0, 0, dst.width, dst.height };
+			downsampleField(dst, src, rect);
+			markFieldDirty(dst);
+			continue;
+		}
+
+		parallelFor(jobs, dirtyCount, 4, [&](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				const FieldRect tile = getTileRect(vf, dirtyTiles[i]);
+				FieldRect rect;
+				rect.x0 = tile.x0 >> shift;
+				rect.y0 = tile.y0 >> shift;
+				rect.x1 = min(((tile.x1 - 1) >> shift) + 1, dst.width);
+				rect.y1 = min(((tile.y1 - 1) >> shift) + 1, dst.height);
+				downsampleField(dst, src, rect);
+			}
+		});
+
+		markFieldDirty(dst);
+	}
+}
+
+const VectorField& getFieldLevel(const FieldMipChain& chain, const VectorField& vf, u32 level)
+{
+	return level ? *chain.levels[min(level, u32(chain.levels.size())) - 1] : vf;
+}
+
+u32 getFieldLevelCount(const FieldMipChain& chain)
+{
+	return u32(chain.levels.size()) + 1;
+}
+
+void exportFlowmap(const VectorField& vf, u8* pixels, u32 rowPitch, JobSystem* jobs)
+{
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			u8* row = pixels + y * rowPitch;
+			for (u32 x = 0; x < vf.width; ++x)
+			{
+				Vec2 v = vf.data[x + y * vf.width];
+				row[x * 4 + 0] = u8(clamp(v.x * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f + 0.5f);
+				row[x * 4 + 1] = u8(clamp(v.y * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f + 0.5f);
+				row[x * 4 + 2] = 0;
+				row[x * 4 + 3] = 255;
+			}
+		}
+	});
+}
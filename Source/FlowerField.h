@@ -0,0 +1,263 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <memory>
+#include <vector>
+
+struct FrameArena;
+struct JobSystem;
+struct ObstacleMask;
+
+struct VectorField
+{
+	// Granularity of change tracking. Caches derived from the field are kept per tile and
+	// compare tile revisions to find out what needs to be recomputed.
+	static constexpr u32 tileSize = 32;
+
+	u32 width  = 0;
+	u32 height = 0;
+	u32 count  = 0;
+
+	Vec2* data = nullptr;
+	bool ownsData = false;
+
+	u32 tileCountX = 0;
+	u32 tileCountY = 0;
+	u32 revision = 0;
+	std::vector<u32> tileRevisions;
+
+	// Cells marked in the mask are locked against brushes and filters
+	const ObstacleMask* obstacles = nullptr;
+
+	VectorField() = default;
+	~VectorField();
+
+	VectorField(const VectorField&) = delete;
+	VectorField& operator=(const VectorField&) = delete;
+};
+
+// Half-open range of cells [x0, x1) x [y0, y1)
+struct FieldRect
+{
+	u32 x0, y0;
+	u32 x1, y1;
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+};
+
+enum class ObstacleTileState : u8
+{
+	Free,
+	Blocked,
+	Mixed,
+};
+
+// One bit per cell, set for blocked cells. A word covers one row of a field tile,
+// so every tile has a summary state that lets field operations skip or fully process it.
+struct ObstacleMask
+{
+	u32 width = 0;
+	u32 height = 0;
+	u32 wordsPerRow = 0;
+	u32 tileCountX = 0;
+	u32 tileCountY = 0;
+
+	std::vector<u32> bits;
+	std::vector<ObstacleTileState> tileStates;
+
+	// Incremented whenever cells change, so masks derived from this one know when to update
+	u32 revision = 0;
+};
+
+void createObstacleMask(ObstacleMask& mask, u32 width, u32 height);
+
+// Sets or clears cells within the circle given in normalized field coordinates
+void paintObstacles(ObstacleMask& mask, const Vec2& pos, float radius, bool blocked);
+
+// Half resolution mask (rounded up), where a cell is blocked when any of the 2x2 source cells it covers is blocked
+void downsampleObstacleMask(ObstacleMask& dst, const ObstacleMask& src);
+
+inline u32 getObstacleBits(const ObstacleMask& mask, u32 tileX, u32 y)
+{
+	return mask.bits[tileX + y * mask.wordsPerRow];
+}
+
+inline bool isBlocked(const ObstacleMask& mask, u32 x, u32 y)
+{
+	return (getObstacleBits(mask, x / 32, y) >> (x % 32)) & 1;
+}
+
+inline ObstacleTileState getObstacleTileState(const ObstacleMask* mask, u32 tileX, u32 tileY)
+{
+	return mask ? mask->tileStates[tileX + tileY * mask->tileCountX] : ObstacleTileState::Free;
+}
+
+// Calls fn(x0, x1, blockedBits) for the spans of row y within [x0, x1) that are not entirely blocked,
+// split at tile boundaries. Bit (x % tileSize) of blockedBits is set for blocked cells, it is zero in free tiles.
+template <typename Fn>
+inline void forEachUnblockedSpan(const VectorField& vf, u32 y, u32 x0, u32 x1, Fn fn)
+{
+	const ObstacleMask* mask = vf.obstacles;
+	if (!mask)
+	{
+		fn(x0, x1, 0u);
+		return;
+	}
+
+	const u32 tileY = y / VectorField::tileSize;
+	for (u32 spanBegin = x0; spanBegin < x1;)
+	{
+		const u32 tileX = spanBegin / VectorField::tileSize;
+		const u32 spanEnd = min(x1, (tileX + 1) * VectorField::tileSize);
+
+		switch (getObstacleTileState(mask, tileX, tileY))
+		{
+		case ObstacleTileState::Free:    fn(spanBegin, spanEnd, 0u); break;
+		case ObstacleTileState::Blocked: break;
+		case ObstacleTileState::Mixed:   fn(spanBegin, spanEnd, getObstacleBits(*mask, tileX, y)); break;
+		}
+
+		spanBegin = spanEnd;
+	}
+}
+
+inline bool isBlockedBit(u32 blockedBits, u32 x)
+{
+	return (blockedBits >> (x % VectorField::tileSize)) & 1;
+}
+
+enum class BrushTool : u32
+{
+	Comb,
+	Dampen,
+};
+
+struct BrushStroke
+{
+	BrushTool tool;
+	Vec2 prev;
+	Vec2 cur;
+	float radius;
+};
+
+// Limits for strokes coming from outside the editor (library API, server). Larger brushes cover no additional cells,
+// positions further out can't reach the field, and smaller radii would overflow the comb force.
+static constexpr float minBrushRadius = 1e-6f;
+static constexpr float maxBrushRadius = 1.0f;
+
+// Known tool, radius within the limits and positions at most maxBrushRadius outside the field. NaN and infinity fail.
+bool isValidBrushStroke(const BrushStroke& s);
+
+// Rotations are clockwise as displayed, with y pointing down. Vectors are rotated or mirrored along with the cells.
+enum class FieldTransform : u32
+{
+	Rotate90,
+	Rotate180,
+	Rotate270,
+	FlipX,     // mirror left to right
+	FlipY,     // mirror top to bottom
+	Transpose, // mirror along the main diagonal
+};
+
+enum class FieldFilter : u32
+{
+	Smooth,    // box blur, param is the radius in cells
+	Normalize, // rescale non-zero vectors to unit length, param is unused
+};
+
+// Storage may be provided by the caller (width * height elements) and must outlive the field.
+// When storage is null, the field allocates and owns its data.
+void createVectorField(VectorField& vf, u32 width, u32 height, Vec2* storage = nullptr);
+void destroyVectorField(VectorField& vf);
+
+void initVectorField(VectorField& vf, const Vec2& value);
+
+// Every function that writes to the field marks what it touched.
+// Code writing to the data directly must do the same.
+void markFieldDirty(VectorField& vf, const FieldRect& rect);
+void markFieldDirty(VectorField& vf);
+
+FieldRect getTileRect(const VectorField& vf, u32 tileIndex);
+
+// Tile revisions of a field last seen by a cache of values derived from it
+struct FieldTileCache
+{
+	const VectorField* field = nullptr;
+	std::vector<u32> revisions;
+};
+
+// Points the cache at vf with none of its tiles seen yet
+void resetFieldTileCache(FieldTileCache& cache, const VectorField& vf);
+
+// Sets dirty[tileIndex] for tiles of vf changed since the previous call and for tiles up to spread tiles away from them,
+// whose cached values read across tile edges, then marks the changes as seen. Flags of earlier calls are kept.
+void flagDirtyTiles(FieldTileCache& cache, const VectorField& vf, u32 spread, u32* dirty);
+
+// Replaces the flags in place with the indices of the flagged tiles in increasing order and returns their count
+u32 compactDirtyTiles(u32* dirty, u32 tileCount);
+
+// Indices of tiles flagged by flagDirtyTiles, in increasing order. dirtyTiles must have room for every tile of vf.
+// Returns the number of dirty tiles.
+u32 collectDirtyTiles(FieldTileCache& cache, const VectorField& vf, u32 spread, u32* dirtyTiles);
+
+// Bins items into every tile their bounds overlap, in compressed row storage: the items of tile t end up in
+// items[offsets[t], offsets[t + 1]), in their original order. Bounds are in tiles, as returned by getRectTileBounds.
+// countTileBins fills offsets (tile count + 1 entries) and touchedTiles (tiles with any items, increasing order),
+// returns the number of touched tiles, and leaves the size of items in offsets[tile count] for fillTileBins.
+FieldRect getRectTileBounds(const FieldRect& rect);
+u32 countTileBins(const VectorField& vf, const FieldRect* itemTileBounds, u32 itemCount, u32* offsets, u32* touchedTiles);
+void fillTileBins(const VectorField& vf, const FieldRect* itemTileBounds, u32 itemCount, u32* offsets, u32* items);
+
+// Central differences over the horizontal and vertical neighbors of a cell, shared by every cache of these quantities
+inline float getDivergence(const Vec2& left, const Vec2& right, const Vec2& up, const Vec2& down)
+{
+	return 0.5f * ((right.x - left.x) + (down.y - up.y));
+}
+
+inline float getCurl(const Vec2& left, const Vec2& right, const Vec2& up, const Vec2& down)
+{
+	return 0.5f * ((right.y - left.y) - (down.x - up.x));
+}
+
+const Vec2& sample(const VectorField& vf, const Vec2& uv);
+
+// Cells that may be touched by a square brush footprint
+FieldRect getBrushRect(const VectorField& vf, const Vec2& brushPos, float brushRadius);
+
+// Box filtered mip chain of a field, so views can pick a level with a bounded cell count on screen.
+// Level 0 is half the source resolution. Only tiles changed in the source since the previous update are rebuilt.
+struct FieldMipChain
+{
+	FieldTileCache source;
+	std::vector<std::unique_ptr<VectorField>> levels;
+};
+
+void updateFieldMipChain(FieldMipChain& chain, const VectorField& vf, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+
+// Level 0 is the source field itself, level n is the mip chain level n - 1
+const VectorField& getFieldLevel(const FieldMipChain& chain, const VectorField& vf, u32 level);
+u32 getFieldLevelCount(const FieldMipChain& chain);
+
+// Field operations below are spread over the job system when one is provided and run on the calling thread otherwise.
+// Functions that take a frame arena allocate their scratch memory from it when one is provided and from the heap otherwise.
+
+void dampen(VectorField& vf, const Vec2& brushPos, float brushRadius, JobSystem* jobs = nullptr);
+void comb(VectorField& vf, const Vec2& brushPrev, const Vec2& brushCur, float brushRadius, JobSystem* jobs = nullptr);
+
+// Same result as applying the strokes one by one in order. Batches are binned by tile and each tile is processed once,
+// so large batches of small dabs touch every tile once and spread over the jobs by tile rather than by brush row.
+void applyStrokes(VectorField& vf, const BrushStroke* strokes, u32 strokeCount, JobSystem* jobs = nullptr,
+	FrameArena* arena = nullptr);
+
+void applyFilter(VectorField& vf, FieldFilter filter, u32 param, JobSystem* jobs = nullptr);
+
+// Flips, 180 degree rotations and all transforms of square fields work in place, one cache-sized block at a time.
+// Other rotations and transposes swap the field dimensions and go through a temporary copy.
+// Cells blocked by the obstacle mask keep their values, free cells receive their transformed source cells.
+// The mask itself stays in place and may be shared with other fields, so transforms that would swap the dimensions
+// of a field with a mask are rejected. Returns false when the field was left untouched.
+bool transformField(VectorField& vf, FieldTransform transform, JobSystem* jobs = nullptr);
+
+// Encodes vectors as 8 bit RGBA texels using the usual flowmap convention (xy * 0.5 + 0.5 in RG).
+void exportFlowmap(const VectorField& vf, u8* pixels, u32 rowPitch, JobSystem* jobs = nullptr);
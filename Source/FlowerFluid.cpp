@@ -0,0 +1,258 @@
+#include "FlowerFluid.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+#include <string.h>
+
+static constexpr u32 rowsPerJob = 16;
+
+static void resizeSolver(FluidSolver& solver, u32 width, u32 height)
+{
+	if (solver.width == width && solver.height == height) return;
+
+	const size_t count = size_t(width) * height;
+
+	solver.width = width;
+	solver.height = height;
+	solver.velocity.assign(count, Vec2(0.0f));
+	solver.velocityScratch.assign(count, Vec2(0.0f));
+	solver.diffusionScratch.assign(count, Vec2(0.0f));
+	solver.pressure.assign(count, 0.0f);
+	solver.pressureScratch.assign(count, 0.0f);
+	solver.divergence.assign(count, 0.0f);
+}
+
+// Resets blocked cells of rows [rowBegin, rowEnd) to their locked values in the field
+static void restoreBlockedCells(Vec2* velocity, const VectorField& vf, u32 rowBegin, u32 rowEnd)
+{
+	const ObstacleMask* mask = vf.obstacles;
+	if (!mask) return;
+
+	for (u32 y = rowBegin; y < rowEnd; ++y)
+	{
+		const u32 tileY = y / VectorField::tileSize;
+		Vec2* out = velocity + y * vf.width;
+		const Vec2* locked = vf.data + y * vf.width;
+
+		for (u32 tileX = 0; tileX < vf.tileCountX; ++tileX)
+		{
+			const u32 x0 = tileX * VectorField::tileSize;
+			const u32 x1 = min(x0 + VectorField::tileSize, vf.width);
+
+			switch (getObstacleTileState(mask, tileX, tileY))
+			{
+			case ObstacleTileState::Free:
+				break;
+			case ObstacleTileState::Blocked:
+				memcpy(out + x0, locked + x0, sizeof(Vec2) * (x1 - x0));
+				break;
+			case ObstacleTileState::Mixed:
+			{
+				const u32 blockedBits = getObstacleBits(*mask, tileX, y);
+				for (u32 x = x0; x < x1; ++x)
+				{
+					if (isBlockedBit(blockedBits, x)) out[x] = locked[x];
+				}
+				break;
+			}
+			}
+		}
+	}
+}
+
+static Vec2 sampleBilinear(const Vec2* data, u32 width, u32 height, float x, float y)
+{
+	x = clamp(x, 0.0f, float(width - 1));
+	y = clamp(y, 0.0f, float(height - 1));
+
+	const u32 x0 = min(u32(x), width - 2);
+	const u32 y0 = min(u32(y), height - 2);
+	const float fx = x - float(x0);
+	const float fy = y - float(y0);
+
+	const Vec2* row0 = data + y0 * width;
+	const Vec2* row1 = row0 + width;
+
+	Vec2 top = lerp(row0[x0], row0[x0 + 1], fx);
+	Vec2 bottom = lerp(row1[x0], row1[x0 + 1], fx);
+
+	return lerp(top, bottom, fy);
+}
+
+// One Jacobi relaxation row of out = (rhs + alpha * sum of 4 neighbours) * invBeta, with clamped borders.
+// Elements are interleaved with the given channel count. The interior loop indexes all rows from the same counter,
+// unsigned i - channels indexing could wrap and keeps compilers from vectorizing it.
+static void jacobiRow(float* out, const float* rhs, const float* center, const float* up, const float* down,
+	u32 elementCount, u32 channels, float alpha, float invBeta)
+{
+	const u32 n = elementCount * channels;
+
+	for (u32 i = 0; i < channels; ++i)
+	{
+		const float left = center[i];
+		const float right = center[i + channels];
+		out[i] = (rhs[i] + alpha * (left + right + up[i] + down[i])) * invBeta;
+	}
+
+	{
+		float* interiorOut = out + channels;
+		const float* interiorRhs = rhs + channels;
+		const float* interiorUp = up + channels;
+		const float* interiorDown = down + channels;
+		const float* left = center;
+		const float* right = center + 2 * channels;
+
+		for (u32 i = 0; i < n - 2 * channels; ++i)
+		{
+			interiorOut[i] = (interiorRhs[i] + alpha * (left[i] + right[i] + interiorUp[i] + interiorDown[i])) * invBeta;
+		}
+	}
+
+	for (u32 i = n - channels; i < n; ++i)
+	{
+		const float left = center[i - channels];
+		const float right = center[i];
+		out[i] = (rhs[i] + alpha * (left + right + up[i] + down[i])) * invBeta;
+	}
+}
+
+// When locked is set, the solve is over its vectors (2 channels) and its blocked cells are held at their values
+static void jacobi(float* x, float* scratch, const float* rhs, u32 width, u32 height, u32 channels,
+	float alpha, float invBeta, u32 iterations, const VectorField* locked, JobSystem* jobs)
+{
+	const u32 rowSize = width * channels;
+
+	for (u32 iteration = 0; iteration < iterations; ++iteration)
+	{
+		parallelFor(jobs, height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+		{
+			for (u32 y = rowBegin; y < rowEnd; ++y)
+			{
+				const float* center = x + y * rowSize;
+				const float* up = x + (y > 0 ? y - 1 : 0) * rowSize;
+				const float* down = x + min(y + 1, height - 1) * rowSize;
+				jacobiRow(scratch + y * rowSize, rhs + y * rowSize, center, up, down, width, channels, alpha, invBeta);
+			}
+
+			if (locked)
+			{
+				restoreBlockedCells(reinterpret_cast<Vec2*>(scratch), *locked, rowBegin, rowEnd);
+			}
+		});
+
+		// Ping-pong through the scratch buffer and copy back on odd iteration counts
+		float* temp = x; x = scratch; scratch = temp;
+	}
+
+	if (iterations & 1)
+	{
+		memcpy(scratch, x, sizeof(float) * rowSize * height);
+	}
+}
+
+static void advect(const FluidSolver& solver, const VectorField& vf, const Vec2* src, Vec2* dst, float cellsPerUnit, float decay,
+	JobSystem* jobs)
+{
+	const u32 width = solver.width;
+	const u32 height = solver.height;
+
+	parallelFor(jobs, height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			for (u32 x = 0; x < width; ++x)
+			{
+				const Vec2 v = src[x + y * width];
+				const float px = float(x) - v.x * cellsPerUnit;
+				const float py = float(y) - v.y * cellsPerUnit;
+				dst[x + y * width] = sampleBilinear(src, width, height, px, py) * decay;
+			}
+		}
+
+		restoreBlockedCells(dst, vf, rowBegin, rowEnd);
+	});
+}
+
+static void computeDivergence(const Vec2* velocity, float* divergence, u32 width, u32 height, JobSystem* jobs)
+{
+	parallelFor(jobs, height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			const Vec2* center = velocity + y * width;
+			const Vec2* up = velocity + (y > 0 ? y - 1 : 0) * width;
+			const Vec2* down = velocity + min(y + 1, height - 1) * width;
+			float* out = divergence + y * width;
+
+			for (u32 x = 0; x < width; ++x)
+			{
+				const float left = center[x > 0 ? x - 1 : 0].x;
+				const float right = center[min(x + 1, width - 1)].x;
+				out[x] = -0.5f * (right - left + down[x].y - up[x].y);
+			}
+		}
+	});
+}
+
+static void subtractPressureGradient(Vec2* velocity, const float* pressure, const VectorField& vf, JobSystem* jobs)
+{
+	const u32 width = vf.width;
+	const u32 height = vf.height;
+
+	parallelFor(jobs, height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			const float* center = pressure + y * width;
+			const float* up = pressure + (y > 0 ? y - 1 : 0) * width;
+			const float* down = pressure + min(y + 1, height - 1) * width;
+			Vec2* out = velocity + y * width;
+
+			for (u32 x = 0; x < width; ++x)
+			{
+				const float left = center[x > 0 ? x - 1 : 0];
+				const float right = center[min(x + 1, width - 1)];
+				out[x].x -= 0.5f * (right - left);
+				out[x].y -= 0.5f * (down[x] - up[x]);
+			}
+		}
+
+		restoreBlockedCells(velocity, vf, rowBegin, rowEnd);
+	});
+}
+
+void stepFluid(FluidSolver& solver, VectorField& vf, const FluidSettings& settings, JobSystem* jobs)
+{
+	if (vf.width < 2 || vf.height < 2) return;
+
+	resizeSolver(solver, vf.width, vf.height);
+
+	const u32 width = vf.width;
+	const u32 height = vf.height;
+	const float cellScale = float(max(width, height));
+	const float dt = settings.timeStep;
+
+	// Advect the field through itself. The field is only written at the end, it holds the values of locked cells until then.
+	memcpy(solver.velocityScratch.data(), vf.data, sizeof(Vec2) * vf.count);
+	const float decay = max(0.0f, 1.0f - settings.dissipation * dt);
+	advect(solver, vf, solver.velocityScratch.data(), solver.velocity.data(), settings.speed * dt * cellScale, decay, jobs);
+
+	// Implicit viscosity: (1 + 4a) x - a * neighbours = x0
+	if (settings.viscosity > 0.0f && settings.diffusionIterations)
+	{
+		const float a = dt * settings.viscosity * cellScale * cellScale;
+		memcpy(solver.velocityScratch.data(), solver.velocity.data(), sizeof(Vec2) * vf.count);
+		jacobi(reinterpret_cast<float*>(solver.velocity.data()), reinterpret_cast<float*>(solver.diffusionScratch.data()),
+			reinterpret_cast<const float*>(solver.velocityScratch.data()),
+			width, height, 2, a, 1.0f / (1.0f + 4.0f * a), settings.diffusionIterations, &vf, jobs);
+	}
+
+	// Pressure projection makes the field divergence-free
+	computeDivergence(solver.velocity.data(), solver.divergence.data(), width, height, jobs);
+	jacobi(solver.pressure.data(), solver.pressureScratch.data(), solver.divergence.data(),
+		width, height, 1, 1.0f, 0.25f, settings.pressureIterations, nullptr, jobs);
+	subtractPressureGradient(solver.velocity.data(), solver.pressure.data(), vf, jobs);
+
+	memcpy(vf.data, solver.velocity.data(), sizeof(Vec2) * vf.count);
+	markFieldDirty(vf);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+struct JobSystem;
+struct VectorField;
+
+// Stable fluids style self-advection of a VectorField (semi-Lagrangian advection, implicit
+// viscosity and pressure projection). Brush strokes applied between steps act as forces.
+struct FluidSettings
+{
+	float timeStep = 1.0f / 60.0f;
+
+	// Distance in normalized field units travelled per second by a unit length vector
+	float speed = 0.15f;
+
+	// Kinematic viscosity in normalized field units squared per second
+	float viscosity = 0.00001f;
+
+	// Fraction of velocity lost per second
+	float dissipation = 0.0f;
+
+	u32 diffusionIterations = 8;
+	u32 pressureIterations = 24;
+};
+
+// Scratch buffers reused between steps. Pressure is kept to warm-start the next projection.
+struct FluidSolver
+{
+	u32 width = 0;
+	u32 height = 0;
+
+	std::vector<Vec2> velocity;
+	std::vector<Vec2> velocityScratch;
+	std::vector<Vec2> diffusionScratch;
+	std::vector<float> pressure;
+	std::vector<float> pressureScratch;
+	std::vector<float> divergence;
+};
+
+// Cells blocked by the field's obstacle mask keep their vectors and act as fixed velocity boundaries.
+void stepFluid(FluidSolver& solver, VectorField& vf, const FluidSettings& settings, JobSystem* jobs = nullptr);
@@ -0,0 +1,166 @@
+#include "FlowerHeightmap.h"
+#include "FlowerField.h"
+#include "FlowerImage.h"
+#include "FlowerJobs.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
+static constexpr u32 rowsPerJob = 16;
+
+static bool hasExtension(const char* path, const char* extension)
+{
+	const size_t pathLength = strlen(path);
+	const size_t extensionLength = strlen(extension);
+	if (pathLength < extensionLength) return false;
+
+	for (size_t i = 0; i < extensionLength; ++i)
+	{
+		if (tolower(path[pathLength - extensionLength + i]) != extension[i]) return false;
+	}
+	return true;
+}
+
+bool loadHeightmap(Heightmap& hm, const char* path)
+{
+	if (hasExtension(path, ".pgm"))
+	{
+		u32 maxValue = 0;
+		if (!loadPgm(path, hm.width, hm.height, maxValue, hm.heights)) return false;
+		hm.heightScale = 1.0f / float(maxValue);
+		return true;
+	}
+
+	std::vector<u8> rgba;
+	if (!loadTga(path, hm.width, hm.height, rgba)) return false;
+
+	hm.heights.resize(size_t(hm.width) * hm.height);
+	for (size_t i = 0; i < hm.heights.size(); ++i)
+	{
+		hm.heights[i] = rgba[i * 4];
+	}
+	hm.heightScale = 1.0f / 255.0f;
+	return true;
+}
+
+// Scharr derivatives at column x from three rows, scaled by 32 (a slope of 1 per texel gives 32)
+static inline void scharr(const u16* r0, const u16* r1, const u16* r2, u32 xm, u32 x, u32 xp, s32& gx, s32& gy)
+{
+	gx = 3 * (s32(r0[xp]) - s32(r0[xm])) + 10 * (s32(r1[xp]) - s32(r1[xm])) + 3 * (s32(r2[xp]) - s32(r2[xm]));
+	gy = 3 * (s32(r2[xm]) - s32(r0[xm])) + 10 * (s32(r2[x]) - s32(r0[x])) + 3 * (s32(r2[xp]) - s32(r0[xp]));
+}
+
+// Adds (sign 1) or removes (sign -1) the gradient of heightmap row y to the column sums.
+// Integer sums keep the sliding window exact however far it travels.
+static void accumulateGradientRow(const Heightmap& hm, u32 y, s64 sign, s64* sumX, s64* sumY)
+{
+	const u32 w = hm.width;
+	const u16* r0 = hm.heights.data() + size_t(y > 0 ? y - 1 : 0) * w;
+	const u16* r1 = hm.heights.data() + size_t(y) * w;
+	const u16* r2 = hm.heights.data() + size_t(min(y + 1, hm.height - 1)) * w;
+
+	s32 gx, gy;
+	scharr(r0, r1, r2, 0, 0, min(1u, w - 1), gx, gy);
+	sumX[0] += sign * gx;
+	sumY[0] += sign * gy;
+
+	for (u32 x = 1; x + 1 < w; ++x)
+	{
+		scharr(r0, r1, r2, x - 1, x, x + 1, gx, gy);
+		sumX[x] += sign * gx;
+		sumY[x] += sign * gy;
+	}
+
+	if (w > 1)
+	{
+		scharr(r0, r1, r2, w - 2, w - 1, w - 1, gx, gy);
+		sumX[w - 1] += sign * gx;
+		sumY[w - 1] += sign * gy;
+	}
+}
+
+// Heightmap texels [begin, end) covered by field cell i, grown by radius and clamped to the heightmap
+static void getFootprint(u32 i, u32 fieldSize, u32 mapSize, u32 radius, u32& begin, u32& end)
+{
+	const u32 first = u32(u64(i) * mapSize / fieldSize);
+	const u32 last = max(first + 1, u32((u64(i + 1) * mapSize + fieldSize - 1) / fieldSize));
+	begin = first > radius ? first - radius : 0;
+	end = min(mapSize, last + radius);
+}
+
+void generateHeightmapFlow(VectorField& vf, const Heightmap& hm, const HeightmapFlowSettings& settings, JobSystem* jobs)
+{
+	if (hm.heights.empty()) return;
+
+	const u32 radius = settings.smoothRadius;
+
+	std::vector<u32> columnBegin(vf.width), columnEnd(vf.width);
+	for (u32 x = 0; x < vf.width; ++x)
+	{
+		getFootprint(x, vf.width, hm.width, radius, columnBegin[x], columnEnd[x]);
+	}
+
+	// Scharr normalization, texel heights and the slope across the whole heightmap width
+	const float gradientScale = hm.heightScale * float(hm.width) / 32.0f;
+
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		std::vector<s64> sumX(hm.width, 0), sumY(hm.width, 0);
+		std::vector<s64> prefixX(hm.width + 1), prefixY(hm.width + 1);
+
+		// Heightmap rows [windowBegin, windowEnd) are in the column sums.
+		// Footprints of consecutive field rows only move down, so the window slides.
+		u32 windowBegin, windowEnd;
+		getFootprint(rowBegin, vf.height, hm.height, radius, windowBegin, windowEnd);
+		windowEnd = windowBegin;
+
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			u32 footprintBegin, footprintEnd;
+			getFootprint(y, vf.height, hm.height, radius, footprintBegin, footprintEnd);
+
+			for (; windowEnd < footprintEnd; ++windowEnd) accumulateGradientRow(hm, windowEnd, 1, sumX.data(), sumY.data());
+			for (; windowBegin < footprintBegin; ++windowBegin) accumulateGradientRow(hm, windowBegin, -1, sumX.data(), sumY.data());
+
+			prefixX[0] = 0;
+			prefixY[0] = 0;
+			for (u32 x = 0; x < hm.width; ++x)
+			{
+				prefixX[x + 1] = prefixX[x] + sumX[x];
+				prefixY[x + 1] = prefixY[x] + sumY[x];
+			}
+
+			const float rowScale = gradientScale / float(windowEnd - windowBegin);
+			Vec2* row = vf.data + y * vf.width;
+
+			forEachUnblockedSpan(vf, y, 0, vf.width, [&](u32 x0, u32 x1, u32 blockedBits)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					if (isBlockedBit(blockedBits, x)) continue;
+
+					const u32 begin = columnBegin[x];
+					const u32 end = columnEnd[x];
+					const float scale = -rowScale / float(end - begin);
+
+					Vec2 v = Vec2(float(prefixX[end] - prefixX[begin]), float(prefixY[end] - prefixY[begin])) * scale;
+
+					if (settings.normalize)
+					{
+						const float length = v.length();
+						v = length > 0.0f ? v * (settings.strength / length) : Vec2(0.0f);
+					}
+					else
+					{
+						v *= settings.strength;
+					}
+
+					row[x] = v;
+				}
+			});
+		}
+	});
+
+	markFieldDirty(vf);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+struct JobSystem;
+struct VectorField;
+
+// Terrain heights, stored as loaded and scaled to [0, 1] by heightScale
+struct Heightmap
+{
+	u32 width = 0;
+	u32 height = 0;
+	float heightScale = 1.0f;
+	std::vector<u16> heights;
+};
+
+// Reads 8 or 16 bit binary PGM files (.pgm) or the red channel of uncompressed TGA files (anything else)
+bool loadHeightmap(Heightmap& hm, const char* path);
+
+struct HeightmapFlowSettings
+{
+	// Box filter radius applied to the gradient, in heightmap texels
+	u32 smoothRadius = 0;
+
+	// A height change of 1 across the heightmap width gives a vector length of strength
+	float strength = 1.0f;
+
+	// Writes unit length vectors scaled by strength, so only the downhill direction is kept
+	bool normalize = false;
+};
+
+// Fills the field with the downhill direction (negative gradient) of the heightmap, computed with a Scharr filter.
+// Heightmaps of any resolution are box filtered onto the field, smoothing is folded into the same sliding window.
+void generateHeightmapFlow(VectorField& vf, const Heightmap& hm, const HeightmapFlowSettings& settings, JobSystem* jobs = nullptr);
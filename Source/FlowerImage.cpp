@@ -0,0 +1,164 @@
+#include "FlowerImage.h"
+
+#include <stdio.h>
+
+bool saveTga(const char* path, u32 width, u32 height, const u8* rgba)
+{
+	if (width > 0xFFFF || height > 0xFFFF) return false;
+
+	FILE* f = fopen(path, "wb");
+	if (!f) return false;
+
+	u8 header[18] = {};
+	header[2] = 2; // uncompressed true color
+	header[12] = u8(width);
+	header[13] = u8(width >> 8);
+	header[14] = u8(height);
+	header[15] = u8(height >> 8);
+	header[16] = 32;
+	header[17] = 0x28; // top-left origin, 8 alpha bits
+
+	std::vector<u8> bgra(size_t(width) * height * 4);
+	for (size_t i = 0; i < bgra.size(); i += 4)
+	{
+		bgra[i + 0] = rgba[i + 2];
+		bgra[i + 1] = rgba[i + 1];
+		bgra[i + 2] = rgba[i + 0];
+		bgra[i + 3] = rgba[i + 3];
+	}
+
+	bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+	ok = ok && fwrite(bgra.data(), bgra.size(), 1, f) == 1;
+
+	return fclose(f) == 0 && ok;
+}
+
+// Bytes from the current position to the end of the file. Header dimensions are checked against it before
+// allocating, so a corrupt or hostile header can't request more memory than the file could fill.
+static bool getRemainingFileSize(FILE* f, size_t& size)
+{
+	const long position = ftell(f);
+	if (position < 0 || fseek(f, 0, SEEK_END) != 0) return false;
+
+	const long end = ftell(f);
+	if (end < position || fseek(f, position, SEEK_SET) != 0) return false;
+
+	size = size_t(end - position);
+	return true;
+}
+
+bool loadTga(const char* path, u32& width, u32& height, std::vector<u8>& rgba)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+
+	u8 header[18] = {};
+	bool ok = fread(header, sizeof(header), 1, f) == 1;
+
+	const u32 idLength = header[0];
+	const u32 colorMapType = header[1];
+	const u32 imageType = header[2];
+	const u32 bitsPerPixel = header[16];
+	const bool topLeftOrigin = (header[17] & 0x20) != 0;
+
+	ok = ok && colorMapType == 0 && imageType == 2 && (bitsPerPixel == 24 || bitsPerPixel == 32);
+	ok = ok && fseek(f, long(idLength), SEEK_CUR) == 0;
+
+	width = header[12] | (header[13] << 8);
+	height = header[14] | (header[15] << 8);
+
+	const u32 bytesPerPixel = bitsPerPixel / 8;
+	const size_t dataSize = size_t(width) * height * bytesPerPixel;
+
+	size_t remainingSize = 0;
+	ok = ok && width && height && getRemainingFileSize(f, remainingSize) && dataSize <= remainingSize;
+
+	std::vector<u8> bgra;
+	if (ok)
+	{
+		bgra.resize(dataSize);
+		ok = fread(bgra.data(), bgra.size(), 1, f) == 1;
+	}
+
+	fclose(f);
+
+	if (!ok) return false;
+
+	rgba.resize(size_t(width) * height * 4);
+	for (u32 y = 0; y < height; ++y)
+	{
+		const u8* src = &bgra[size_t(topLeftOrigin ? y : height - 1 - y) * width * bytesPerPixel];
+		u8* dst = &rgba[size_t(y) * width * 4];
+		for (u32 x = 0; x < width; ++x)
+		{
+			dst[x * 4 + 0] = src[x * bytesPerPixel + 2];
+			dst[x * 4 + 1] = src[x * bytesPerPixel + 1];
+			dst[x * 4 + 2] = src[x * bytesPerPixel + 0];
+			dst[x * 4 + 3] = bytesPerPixel == 4 ? src[x * bytesPerPixel + 3] : 255;
+		}
+	}
+
+	return true;
+}
+
+// Next whitespace separated header token, skipping comments
+static bool readPgmHeaderValue(FILE* f, u32& value)
+{
+	int c = fgetc(f);
+	for (;;)
+	{
+		while (c == ' ' || c == '\t' || c == '\r' || c == '\n') c = fgetc(f);
+		if (c != '#') break;
+		while (c != '\n' && c != EOF) c = fgetc(f);
+	}
+
+	if (c < '0' || c > '9') return false;
+
+	value = 0;
+	while (c >= '0' && c <= '9')
+	{
+		value = value * 10 + u32(c - '0');
+		if (value > 0xFFFFFF) return false;
+		c = fgetc(f);
+	}
+
+	// A single whitespace character separates the header from the data
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool loadPgm(const char* path, u32& width, u32& height, u32& maxValue, std::vector<u16>& values)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+
+	char magic[2] = {};
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 && magic[0] == 'P' && magic[1] == '5';
+	ok = ok && readPgmHeaderValue(f, width) && readPgmHeaderValue(f, height) && readPgmHeaderValue(f, maxValue);
+	ok = ok && width && height && maxValue && maxValue <= 0xFFFF;
+
+	const u32 bytesPerValue = maxValue > 0xFF ? 2 : 1;
+	const size_t dataSize = size_t(width) * height * bytesPerValue;
+
+	size_t remainingSize = 0;
+	ok = ok && getRemainingFileSize(f, remainingSize) && dataSize <= remainingSize;
+
+	std::vector<u8> data;
+	if (ok)
+	{
+		data.resize(dataSize);
+		ok = fread(data.data(), data.size(), 1, f) == 1;
+	}
+
+	fclose(f);
+
+	if (!ok) return false;
+
+	// 16 bit values are stored most significant byte first
+	values.resize(size_t(width) * height);
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		values[i] = bytesPerValue == 2 ? u16((data[i * 2] << 8) | data[i * 2 + 1]) : data[i];
+	}
+
+	return true;
+}
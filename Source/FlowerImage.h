@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+// Writes tightly packed 8 bit RGBA texels as an uncompressed, top-left origin TGA file.
+bool saveTga(const char* path, u32 width, u32 height, const u8* rgba);
+
+// Reads an uncompressed 24 or 32 bit true color TGA file into tightly packed 8 bit RGBA texels.
+bool loadTga(const char* path, u32& width, u32& height, std::vector<u8>& rgba);
+
+// Reads a binary (P5) PGM grayscale file. Values are 8 or 16 bit depending on maxValue, which is at most 65535.
+bool loadPgm(const char* path, u32& width, u32& height, u32& maxValue, std::vector<u16>& values);
@@ -0,0 +1,486 @@
+#include "FlowerJobs.h"
+
+#if defined(_WIN32)
+#	define NOMINMAX
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#elif defined(__APPLE__)
+#	include <pthread.h>
+#else
+#	include <pthread.h>
+#	include <sched.h>
+#	include <sys/resource.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+static thread_local const JobSystem* t_jobSystem = nullptr;
+static thread_local u32 t_jobThreadIndex = 0;
+
+static void setCurrentThreadAffinity(u64 mask)
+{
+	if (mask == 0) return;
+
+#if defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(mask));
+#elif defined(__APPLE__)
+	// No affinity API on macOS, the scheduler only accepts hints through thread QoS
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (u32 i = 0; i < 64; ++i)
+	{
+		if (mask & (1ull << i)) CPU_SET(i, &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void setCurrentThreadBackgroundPriority()
+{
+#if defined(_WIN32)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__APPLE__)
+	pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#else
+	// Linux applies nice values per thread
+	setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), 10);
+#endif
+}
+
+// Mask containing only the index-th set bit of mask (wrapping around), or the whole mask when not pinning
+static u64 getWorkerAffinity(u64 mask, u32 index, bool pin)
+{
+	if (!pin || mask == 0) return mask;
+
+	u32 bitCount = 0;
+	for (u32 i = 0; i < 64; ++i)
+	{
+		if (mask & (1ull << i)) ++bitCount;
+	}
+
+	u32 target = index % bitCount;
+	for (u32 i = 0; i < 64; ++i)
+	{
+		if ((mask & (1ull << i)) && target-- == 0) return 1ull << i;
+	}
+
+	return mask;
+}
+
+static void pushJobBack(JobRing& ring, const Job& job)
+{
+	const u32 capacity = u32(ring.storage.size());
+	if (ring.count == capacity)
+	{
+		// Grows by unrolling the ring into a larger one, which only happens while the peak queue depth rises
+		std::vector<Job> storage(max(capacity * 2, 64u));
+		for (u32 i = 0; i < ring.count; ++i)
+		{
+			storage[i] = ring.storage[(ring.head + i) & (capacity - 1)];
+		}
+		ring.storage.swap(storage);
+		ring.head = 0;
+	}
+
+	ring.storage[(ring.head + ring.count) & (u32(ring.storage.size()) - 1)] = job;
+	ring.count++;
+}
+
+static Job popJobBack(JobRing& ring)
+{
+	RUSH_ASSERT(ring.count);
+	ring.count--;
+	return ring.storage[(ring.head + ring.count) & (u32(ring.storage.size()) - 1)];
+}
+
+static Job popJobFront(JobRing& ring)
+{
+	RUSH_ASSERT(ring.count);
+	const Job job = ring.storage[ring.head];
+	ring.head = (ring.head + 1) & (u32(ring.storage.size()) - 1);
+	ring.count--;
+	return job;
+}
+
+static bool isBackgroundThread(const JobSystem& js, u32 threadIndex)
+{
+	return threadIndex > js.workerCount && threadIndex <= js.workerCount + js.backgroundWorkerCount;
+}
+
+// Interactive and foreign threads share queues [0, workerCount] and the foreign queue, background workers only steal
+// from each other, so jobs spawned by background work never delay interactive work.
+static bool popJob(JobSystem& js, u32 threadIndex, Job& job)
+{
+	const bool background = isBackgroundThread(js, threadIndex);
+	const u32 foreignQueueIndex = u32(js.queues.size()) - 1;
+	const u32 queueCount = background ? js.backgroundWorkerCount : js.workerCount + 2;
+	const u32 ownSlot = background ? threadIndex - js.workerCount - 1 : min(threadIndex, js.workerCount + 1);
+
+	// Own queue is used as a stack for locality, other queues are stolen from the opposite end
+	for (u32 i = 0; i < queueCount; ++i)
+	{
+		const u32 slot = (ownSlot + i) % queueCount;
+		const u32 queueIndex = background ? js.workerCount + 1 + slot : (slot <= js.workerCount ? slot : foreignQueueIndex);
+		JobQueue& queue = *js.queues[queueIndex];
+
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (!queue.jobs.count) continue;
+
+		job = i == 0 ? popJobBack(queue.jobs) : popJobFront(queue.jobs);
+
+		if (!background)
+		{
+			js.queuedJobCount.fetch_sub(1);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+static void executeJob(const Job& job)
+{
+	job.fn(job.userData, job.begin, job.end);
+
+	if (job.counter)
+	{
+		job.counter->value.fetch_sub(1);
+	}
+}
+
+static void workerMain(JobSystem* js, u32 threadIndex, u64 affinityMask)
+{
+	t_jobSystem = js;
+	t_jobThreadIndex = threadIndex;
+
+	setCurrentThreadAffinity(affinityMask);
+
+	const u32 spinCount = 64;
+	u32 idleCount = 0;
+
+	while (!js->stopping.load())
+	{
+		Job job;
+		if (popJob(*js, threadIndex, job))
+		{
+			executeJob(job);
+			idleCount = 0;
+		}
+		else if (++idleCount < spinCount)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(js->sleepLock);
+			js->sleepingWorkerCount.fetch_add(1);
+			js->sleepCondition.wait(lock, [js] { return js->queuedJobCount.load() != 0 || js->stopping.load(); });
+			js->sleepingWorkerCount.fetch_sub(1);
+			idleCount = 0;
+		}
+	}
+}
+
+static void backgroundWorkerMain(JobSystem* js, u32 threadIndex, u64 affinityMask)
+{
+	t_jobSystem = js;
+	t_jobThreadIndex = threadIndex;
+
+	setCurrentThreadAffinity(affinityMask);
+	setCurrentThreadBackgroundPriority();
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(js->backgroundLock);
+			js->backgroundCondition.wait(lock, [js] { return js->backgroundJobs.count || js->stopping.load(); });
+
+			if (!js->backgroundJobs.count) break;
+
+			job = popJobFront(js->backgroundJobs);
+		}
+
+		executeJob(job);
+	}
+}
+
+void startJobSystem(JobSystem& js, const JobSystemDesc& desc)
+{
+	u32 workerCount = desc.workerCount;
+	if (workerCount == 0)
+	{
+		u32 reservedThreadCount = 1 + desc.backgroundWorkerCount;
+		u32 hardwareThreadCount = std::thread::hardware_concurrency();
+		workerCount = hardwareThreadCount > reservedThreadCount ? hardwareThreadCount - reservedThreadCount : 0;
+	}
+
+	u64 workerAffinityMask = desc.workerAffinityMask;
+	u64 backgroundAffinityMask = desc.backgroundAffinityMask;
+	if (desc.isolateMainThread && desc.mainThreadAffinityMask)
+	{
+		// Only isolate when some CPUs remain for the workers
+		const u64 allCpus = ~0ull;
+		u64 isolatedWorkerMask = (workerAffinityMask ? workerAffinityMask : allCpus) & ~desc.mainThreadAffinityMask;
+		u64 isolatedBackgroundMask = (backgroundAffinityMask ? backgroundAffinityMask : allCpus) & ~desc.mainThreadAffinityMask;
+		if (isolatedWorkerMask) workerAffinityMask = isolatedWorkerMask;
+		if (isolatedBackgroundMask) backgroundAffinityMask = isolatedBackgroundMask;
+	}
+
+	js.stopping = false;
+	js.queuedJobCount = 0;
+	js.workerCount = workerCount;
+	js.backgroundWorkerCount = desc.backgroundWorkerCount;
+
+	const u32 queueCount = workerCount + desc.backgroundWorkerCount + 2;
+	js.queues.clear();
+	for (u32 i = 0; i < queueCount; ++i)
+	{
+		js.queues.emplace_back(new JobQueue);
+	}
+
+	t_jobSystem = &js;
+	t_jobThreadIndex = 0;
+
+	setCurrentThreadAffinity(desc.mainThreadAffinityMask);
+
+	for (u32 i = 0; i < workerCount; ++i)
+	{
+		js.workers.emplace_back(workerMain, &js, i + 1, getWorkerAffinity(workerAffinityMask, i, desc.pinWorkers));
+	}
+
+	for (u32 i = 0; i < desc.backgroundWorkerCount; ++i)
+	{
+		js.backgroundWorkers.emplace_back(backgroundWorkerMain, &js, workerCount + 1 + i, getWorkerAffinity(backgroundAffinityMask, i, desc.pinWorkers));
+	}
+}
+
+void stopJobSystem(JobSystem& js)
+{
+	{
+		std::lock_guard<std::mutex> guard(js.sleepLock);
+		std::lock_guard<std::mutex> backgroundGuard(js.backgroundLock);
+		js.stopping = true;
+	}
+	js.sleepCondition.notify_all();
+	js.backgroundCondition.notify_all();
+
+	for (std::thread& worker : js.workers)
+	{
+		worker.join();
+	}
+
+	// Background workers drain their queue before exiting
+	for (std::thread& worker : js.backgroundWorkers)
+	{
+		worker.join();
+	}
+
+	// Interactive workers exit without draining, so jobs still queued (including background jobs that fell back
+	// to the interactive queues when there are no background workers) run here
+	Job job;
+	while (popJob(js, 0, job))
+	{
+		executeJob(job);
+	}
+
+	js.workers.clear();
+	js.backgroundWorkers.clear();
+	js.queues.clear();
+	js.workerCount = 0;
+	js.backgroundWorkerCount = 0;
+
+	if (t_jobSystem == &js)
+	{
+		t_jobSystem = nullptr;
+	}
+}
+
+u32 getJobThreadCount(const JobSystem* js)
+{
+	return js ? js->workerCount + js->backgroundWorkerCount + 1 : 1;
+}
+
+u32 getJobThreadIndex(const JobSystem* js)
+{
+	if (!js) return 0;
+	return t_jobSystem == js ? t_jobThreadIndex : getJobThreadCount(js);
+}
+
+void submitJob(JobSystem& js, const Job& job)
+{
+	const u32 queueIndex = getJobThreadIndex(&js);
+	JobQueue& queue = *js.queues[queueIndex];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		pushJobBack(queue.jobs, job);
+	}
+
+	// Only other background workers take jobs from background queues, and they never sleep on the interactive condition
+	if (isBackgroundThread(js, queueIndex)) return;
+
+	js.queuedJobCount.fetch_add(1);
+
+	// Sleeping workers re-check the queued job count under the sleep lock, taking it here avoids lost wake-ups
+	if (js.sleepingWorkerCount.load() != 0)
+	{
+		std::lock_guard<std::mutex> guard(js.sleepLock);
+		js.sleepCondition.notify_one();
+	}
+}
+
+void submitBackgroundJob(JobSystem& js, const Job& job)
+{
+	if (js.backgroundWorkers.empty())
+	{
+		// Without any worker the job would only run once someone waits, run it now instead
+		if (js.workers.empty())
+		{
+			executeJob(job);
+		}
+		else
+		{
+			submitJob(js, job);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(js.backgroundLock);
+		pushJobBack(js.backgroundJobs, job);
+	}
+	js.backgroundCondition.notify_one();
+}
+
+void submitJobRange(JobSystem* js, JobFunction fn, void* userData, u32 count, u32 grainSize, JobCounter& counter)
+{
+	if (count == 0) return;
+
+	if (!js)
+	{
+		fn(userData, 0, count);
+		return;
+	}
+
+	grainSize = grainSize ? grainSize : 1;
+
+	const u32 jobCount = divUp(count, grainSize);
+	counter.value.fetch_add(jobCount);
+
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		Job job;
+		job.fn = fn;
+		job.userData = userData;
+		job.begin = i * grainSize;
+		job.end = min(job.begin + grainSize, count);
+		job.counter = &counter;
+		submitJob(*js, job);
+	}
+}
+
+void waitForCounter(JobSystem& js, JobCounter& counter)
+{
+	const u32 threadIndex = getJobThreadIndex(&js);
+	while (counter.value.load() != 0)
+	{
+		Job job;
+		if (popJob(js, threadIndex, job))
+		{
+			executeJob(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+u32 addGraphJob(JobGraph& graph, std::function<void()> fn)
+{
+	graph.nodes.emplace_back();
+	graph.nodes.back().fn = std::move(fn);
+	return u32(graph.nodes.size() - 1);
+}
+
+void addGraphDependency(JobGraph& graph, u32 before, u32 after)
+{
+	graph.nodes[before].dependents.push_back(after);
+	graph.nodes[after].dependencyCount++;
+}
+
+struct JobGraphContext
+{
+	JobSystem* js;
+	JobGraph* graph;
+	JobCounter counter;
+};
+
+static void submitGraphNode(JobGraphContext& context, u32 nodeIndex);
+
+static void executeGraphNode(void* userData, u32 nodeIndex, u32)
+{
+	JobGraphContext& context = *reinterpret_cast<JobGraphContext*>(userData);
+	JobGraph::Node& node = context.graph->nodes[nodeIndex];
+
+	node.fn();
+
+	for (u32 dependent : node.dependents)
+	{
+		if (context.graph->nodes[dependent].pendingDependencies.fetch_sub(1) == 1)
+		{
+			submitGraphNode(context, dependent);
+		}
+	}
+}
+
+static void submitGraphNode(JobGraphContext& context, u32 nodeIndex)
+{
+	Job job;
+	job.fn = executeGraphNode;
+	job.userData = &context;
+	job.begin = nodeIndex;
+	job.end = nodeIndex + 1;
+	job.counter = &context.counter;
+
+	if (context.js)
+	{
+		submitJob(*context.js, job);
+	}
+	else
+	{
+		executeJob(job);
+	}
+}
+
+void runJobGraph(JobSystem* js, JobGraph& graph)
+{
+	if (graph.nodes.empty()) return;
+
+	JobGraphContext context;
+	context.js = js;
+	context.graph = &graph;
+	context.counter.value = u32(graph.nodes.size());
+
+	for (JobGraph::Node& node : graph.nodes)
+	{
+		node.pendingDependencies = node.dependencyCount;
+	}
+
+	for (u32 i = 0; i < u32(graph.nodes.size()); ++i)
+	{
+		if (graph.nodes[i].dependencyCount == 0)
+		{
+			submitGraphNode(context, i);
+		}
+	}
+
+	if (js)
+	{
+		waitForCounter(*js, context.counter);
+	}
+
+	RUSH_ASSERT(context.counter.value == 0);
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler shared by all Flower subsystems.
+// Each thread has its own double ended queue: owners push and pop at the back, idle threads steal from the front.
+// Threads that wait for jobs (main thread or any foreign thread) help executing them instead of blocking.
+
+typedef void (*JobFunction)(void* userData, u32 begin, u32 end);
+
+struct JobCounter
+{
+	std::atomic<u32> value = { 0 };
+};
+
+struct Job
+{
+	JobFunction fn = nullptr;
+	void* userData = nullptr;
+	u32 begin = 0;
+	u32 end = 0;
+	JobCounter* counter = nullptr;
+};
+
+// Ring buffer of jobs that keeps its storage when it drains, so steady-state submission does not allocate
+struct JobRing
+{
+	std::vector<Job> storage; // power of two size
+	u32 head = 0;
+	u32 count = 0;
+};
+
+struct JobQueue
+{
+	std::mutex lock;
+	JobRing jobs;
+};
+
+struct JobSystemDesc
+{
+	// Interactive workers. 0 selects one per hardware thread, minus the starting thread and background workers.
+	u32 workerCount = 0;
+
+	// Low priority workers that only run jobs submitted with submitBackgroundJob (exports and other non-interactive work).
+	// When 0, background jobs run on the interactive workers, or on the submitting thread when there are none.
+	u32 backgroundWorkerCount = 0;
+
+	// Logical CPU masks, 0 leaves scheduling to the OS. Bit N selects logical CPU N.
+	// Affinity is not supported on macOS and is ignored there.
+	u64 mainThreadAffinityMask = 0;
+	u64 workerAffinityMask = 0;
+	u64 backgroundAffinityMask = 0;
+
+	// Removes the main thread's CPUs from the worker masks, so the main thread never competes with workers.
+	bool isolateMainThread = false;
+
+	// Pins each worker to a single CPU of its mask in turn instead of letting it float within the mask.
+	bool pinWorkers = false;
+};
+
+struct JobSystem
+{
+	// Queue 0 belongs to the thread that started the job system, queues [1..workerCount] to workers,
+	// the next backgroundWorkerCount queues to background workers and the last queue receives jobs pushed
+	// from any other thread. Jobs pushed by background workers are only executed by background workers.
+	std::vector<std::unique_ptr<JobQueue>> queues;
+	std::vector<std::thread> workers;
+	u32 workerCount = 0;
+	u32 backgroundWorkerCount = 0;
+
+	std::atomic<u32> queuedJobCount = { 0 };
+	std::atomic<u32> sleepingWorkerCount = { 0 };
+	std::atomic<bool> stopping = { false };
+
+	std::mutex sleepLock;
+	std::condition_variable sleepCondition;
+
+	std::vector<std::thread> backgroundWorkers;
+	std::mutex backgroundLock;
+	std::condition_variable backgroundCondition;
+	JobRing backgroundJobs;
+};
+
+// The calling thread becomes job thread 0 and gets the main thread affinity.
+void startJobSystem(JobSystem& js, const JobSystemDesc& desc = JobSystemDesc());
+void stopJobSystem(JobSystem& js);
+
+// Number of threads that may execute jobs, including the thread that started the job system and background workers.
+u32 getJobThreadCount(const JobSystem* js);
+
+// Index in [0, getJobThreadCount()) of the calling job thread, or getJobThreadCount() for foreign threads.
+// Useful for indexing per-thread scratch data.
+u32 getJobThreadIndex(const JobSystem* js);
+
+void submitJob(JobSystem& js, const Job& job);
+
+// Queues a job for the low priority background workers.
+void submitBackgroundJob(JobSystem& js, const Job& job);
+
+// Submits fn(userData, begin, end) over [0, count) in grainSize pieces without waiting.
+// The counter is incremented by the number of jobs and reaches zero once all of them have finished.
+// Without a job system the work runs immediately on the calling thread.
+void submitJobRange(JobSystem* js, JobFunction fn, void* userData, u32 count, u32 grainSize, JobCounter& counter);
+
+// Executes pending jobs on the calling thread until the counter reaches zero.
+void waitForCounter(JobSystem& js, JobCounter& counter);
+
+template <typename F>
+static void parallelForTrampoline(void* userData, u32 begin, u32 end)
+{
+	(*reinterpret_cast<F*>(userData))(begin, end);
+}
+
+// Calls fn(begin, end) for disjoint sub-ranges of [0, count) of at most grainSize elements and waits for completion.
+// Runs inline when js is null or when the range fits in a single grain.
+template <typename F>
+void parallelFor(JobSystem* js, u32 count, u32 grainSize, F&& fn)
+{
+	if (count == 0) return;
+
+	grainSize = grainSize ? grainSize : 1;
+
+	if (!js || count <= grainSize || js->workers.empty())
+	{
+		fn(0u, count);
+		return;
+	}
+
+	typedef typename std::remove_reference<F>::type FunctionType;
+
+	const u32 jobCount = divUp(count, grainSize);
+
+	JobCounter counter;
+	counter.value = jobCount;
+
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		Job job;
+		job.fn = parallelForTrampoline<FunctionType>;
+		job.userData = const_cast<void*>(reinterpret_cast<const void*>(&fn));
+		job.begin = i * grainSize;
+		job.end = min(job.begin + grainSize, count);
+		job.counter = &counter;
+		submitJob(*js, job);
+	}
+
+	waitForCounter(*js, counter);
+}
+
+// Task graph: jobs run once all jobs they depend on have finished.
+struct JobGraph
+{
+	struct Node
+	{
+		std::function<void()> fn;
+		std::vector<u32> dependents;
+		u32 dependencyCount = 0;
+		std::atomic<u32> pendingDependencies = { 0 };
+	};
+
+	std::deque<Node> nodes;
+};
+
+u32 addGraphJob(JobGraph& graph, std::function<void()> fn);
+void addGraphDependency(JobGraph& graph, u32 before, u32 after);
+
+// Runs all jobs in the graph and waits for them to finish. The graph may be run again afterwards.
+void runJobGraph(JobSystem* js, JobGraph& graph);
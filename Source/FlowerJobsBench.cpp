@@ -0,0 +1,283 @@
+#include "FlowerJobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Measures job system overhead and frame time jitter.
+// Usage: FlowerJobsBench [workerCount]
+//        FlowerJobsBench jitter [competingThreadCount]
+
+static constexpr u32 runCount = 7;
+
+typedef std::chrono::steady_clock Clock;
+
+static double getElapsedNanoseconds(Clock::time_point start)
+{
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+static double getMedian(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+static void emptyJob(void*, u32, u32) {}
+
+// Nanoseconds per empty job submitted and waited for from the calling thread
+static double benchSubmitJobRange(JobSystem& js, u32 jobCount)
+{
+	JobCounter counter;
+	const Clock::time_point start = Clock::now();
+	submitJobRange(&js, emptyJob, nullptr, jobCount, 1, counter);
+	waitForCounter(js, counter);
+	return getElapsedNanoseconds(start) / jobCount;
+}
+
+// Nanoseconds per grain of a parallelFor that does almost no work
+static double benchParallelFor(JobSystem& js, u32 jobCount)
+{
+	std::atomic<u32> sum = { 0 };
+	const Clock::time_point start = Clock::now();
+	parallelFor(&js, jobCount, 1, [&](u32 begin, u32 end) { sum.fetch_add(end - begin, std::memory_order_relaxed); });
+	const double result = getElapsedNanoseconds(start) / jobCount;
+	RUSH_ASSERT(sum.load() == jobCount);
+	return result;
+}
+
+// Nanoseconds per node of a graph made of layers of independent nodes, each layer depending on the previous one
+static double benchJobGraph(JobSystem& js, u32 layerCount, u32 layerWidth)
+{
+	JobGraph graph;
+	std::atomic<u32> executed = { 0 };
+	for (u32 layer = 0; layer < layerCount; ++layer)
+	{
+		for (u32 i = 0; i < layerWidth; ++i)
+		{
+			const u32 node = addGraphJob(graph, [&executed] { executed.fetch_add(1, std::memory_order_relaxed); });
+			if (layer)
+			{
+				addGraphDependency(graph, node - layerWidth, node);
+			}
+		}
+	}
+
+	const Clock::time_point start = Clock::now();
+	runJobGraph(&js, graph);
+	const double result = getElapsedNanoseconds(start) / graph.nodes.size();
+	RUSH_ASSERT(executed.load() == graph.nodes.size());
+	return result;
+}
+
+// Fixed amount of arithmetic, the result is returned so it can't be optimized away
+static u32 spinWork(u32 iterations, u32 seed)
+{
+	u32 x = seed | 1;
+	for (u32 i = 0; i < iterations; ++i)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	return x;
+}
+
+static u32 getIterationsPerMillisecond()
+{
+	const u32 iterations = 1 << 24;
+	const Clock::time_point start = Clock::now();
+	volatile u32 sink = spinWork(iterations, 1);
+	(void)sink;
+	return u32(max(1.0, iterations / (getElapsedNanoseconds(start) / 1e6)));
+}
+
+struct JitterConfig
+{
+	const char* name;
+	JobSystemDesc desc;
+};
+
+struct ExportLoad
+{
+	u32 iterations = 0;
+	std::atomic<u32> inFlight = { 0 };
+	std::atomic<u32> sink = { 0 };
+};
+
+static void exportLoadJob(void* userData, u32, u32)
+{
+	ExportLoad& load = *reinterpret_cast<ExportLoad*>(userData);
+	load.sink.fetch_add(spinWork(load.iterations, load.inFlight.load()));
+	load.inFlight.fetch_sub(1);
+}
+
+// Runs frames of parallel work while exports run as background jobs and other threads compete for the CPUs.
+// Frame time statistics match the ones logged by the app with FLOWER_FRAME_STATS=1.
+static void benchFrameJitter(const JitterConfig& config, u32 iterationsPerMs, u32 competingThreadCount)
+{
+	static constexpr u32 frameCount = 300;
+	static constexpr u32 framePieces = 64;
+	static constexpr u32 exportsInFlight = 2;
+
+	std::atomic<bool> stopCompeting = { false };
+	std::atomic<u32> competingSink = { 0 };
+	std::vector<std::thread> competing;
+	for (u32 i = 0; i < competingThreadCount; ++i)
+	{
+		competing.emplace_back([&stopCompeting, &competingSink, iterationsPerMs, i]
+		{
+			while (!stopCompeting.load())
+			{
+				competingSink.fetch_add(spinWork(iterationsPerMs / 10, i));
+			}
+		});
+	}
+
+	JobSystem js;
+	startJobSystem(js, config.desc);
+
+	ExportLoad load;
+	load.iterations = iterationsPerMs * 8;
+
+	const u32 pieceIterations = max(1u, iterationsPerMs * 4 / framePieces);
+	std::atomic<u32> frameSink = { 0 };
+
+	std::vector<double> frameTimes;
+	for (u32 frame = 0; frame < frameCount; ++frame)
+	{
+		const Clock::time_point start = Clock::now();
+
+		// Exports run inline when there are no workers, so the count to submit is taken once per frame
+		const u32 exportCount = exportsInFlight - min(load.inFlight.load(), exportsInFlight);
+		for (u32 i = 0; i < exportCount; ++i)
+		{
+			load.inFlight.fetch_add(1);
+
+			Job job;
+			job.fn = exportLoadJob;
+			job.userData = &load;
+			submitBackgroundJob(js, job);
+		}
+
+		parallelFor(&js, framePieces, 1, [&](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				frameSink.fetch_add(spinWork(pieceIterations, i));
+			}
+		});
+		frameTimes.push_back(getElapsedNanoseconds(start) / 1e6);
+	}
+
+	stopJobSystem(js);
+	RUSH_ASSERT(load.inFlight.load() == 0);
+
+	stopCompeting = true;
+	for (std::thread& thread : competing)
+	{
+		thread.join();
+	}
+
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	for (double frameTime : frameTimes)
+	{
+		sum += frameTime;
+		sumSquares += frameTime * frameTime;
+	}
+
+	const double mean = sum / frameCount;
+	const double variance = max(0.0, sumSquares / frameCount - mean * mean);
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+	const double p99 = frameTimes[frameCount * 99 / 100];
+
+	printf("%-44s mean %6.2f ms, jitter %6.2f ms, p99 %6.2f ms, max %6.2f ms\n", config.name, mean, sqrt(variance), p99,
+		frameTimes.back());
+}
+
+static void benchJitter(u32 competingThreadCount)
+{
+	const u32 iterationsPerMs = getIterationsPerMillisecond();
+	printf("frames of 4 ms work in 64 pieces, 2 exports of 8 ms in flight, %u competing threads\n", competingThreadCount);
+
+	JitterConfig configs[3];
+
+	configs[0].name = "exports on interactive workers";
+
+	configs[1].name = "one background worker";
+	configs[1].desc.backgroundWorkerCount = 1;
+
+	configs[2].name = "one background worker, isolated main thread";
+	configs[2].desc.backgroundWorkerCount = 1;
+	configs[2].desc.mainThreadAffinityMask = 1;
+	configs[2].desc.isolateMainThread = true;
+	configs[2].desc.pinWorkers = true;
+
+	for (const JitterConfig& config : configs)
+	{
+		benchFrameJitter(config, iterationsPerMs, competingThreadCount);
+	}
+}
+
+static void benchDispatch(const JobSystemDesc& desc)
+{
+	JobSystem js;
+	startJobSystem(js, desc);
+
+	printf("job threads: %u\n", getJobThreadCount(&js));
+
+	struct Bench
+	{
+		const char* name;
+		std::function<double()> fn;
+	};
+
+	const Bench benches[] = {
+		{ "submitJobRange, 100000 empty jobs", [&] { return benchSubmitJobRange(js, 100000); } },
+		{ "parallelFor, 100000 grains", [&] { return benchParallelFor(js, 100000); } },
+		{ "runJobGraph, 100 layers of 100 nodes", [&] { return benchJobGraph(js, 100, 100); } },
+	};
+
+	for (const Bench& bench : benches)
+	{
+		bench.fn(); // warm up queues and wake the workers
+
+		std::vector<double> samples;
+		for (u32 i = 0; i < runCount; ++i)
+		{
+			samples.push_back(bench.fn());
+		}
+
+		printf("%-40s median %7.1f ns/job, best %7.1f ns/job\n", bench.name, getMedian(samples),
+			*std::min_element(samples.begin(), samples.end()));
+	}
+
+	stopJobSystem(js);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "jitter") == 0)
+	{
+		benchJitter(argc > 2 ? u32(atoi(argv[2])) : std::thread::hardware_concurrency());
+		return 0;
+	}
+
+	JobSystemDesc desc;
+	if (argc > 1)
+	{
+		desc.workerCount = u32(atoi(argv[1]));
+	}
+
+	benchDispatch(desc);
+
+	return 0;
+}
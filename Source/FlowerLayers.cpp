@@ -0,0 +1,167 @@
+#include "FlowerLayers.h"
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+#include <string.h>
+
+void createLayerStack(LayerStack& stack, u32 width, u32 height)
+{
+	stack.width = width;
+	stack.height = height;
+	stack.layers.clear();
+	stack.activeLayer = 0;
+
+	createObstacleMask(stack.obstacles, width, height);
+	createVectorField(stack.composite, width, height);
+	initVectorField(stack.composite, Vec2(0.0f));
+
+	addLayer(stack);
+}
+
+u32 addLayer(LayerStack& stack, LayerBlendMode blendMode, float opacity)
+{
+	std::unique_ptr<FieldLayer> layer(new FieldLayer);
+	layer->blendMode = blendMode;
+	layer->opacity = opacity;
+	createVectorField(layer->field, stack.width, stack.height);
+	initVectorField(layer->field, Vec2(0.0f));
+	layer->field.obstacles = &stack.obstacles;
+	createMultiresField(layer->detail, layer->field);
+
+	const u32 layerIndex = stack.layers.empty() ? 0 : stack.activeLayer + 1;
+	stack.layers.insert(stack.layers.begin() + layerIndex, std::move(layer));
+	stack.activeLayer = layerIndex;
+
+	invalidateLayerComposite(stack);
+
+	return layerIndex;
+}
+
+void removeLayer(LayerStack& stack, u32 layerIndex)
+{
+	// The stack always keeps at least one layer to paint into
+	if (stack.layers.size() <= 1 || layerIndex >= stack.layers.size()) return;
+
+	stack.layers.erase(stack.layers.begin() + layerIndex);
+	stack.activeLayer = min(stack.activeLayer, u32(stack.layers.size()) - 1);
+
+	invalidateLayerComposite(stack);
+}
+
+FieldLayer& getActiveLayer(LayerStack& stack)
+{
+	return *stack.layers[stack.activeLayer];
+}
+
+void invalidateLayerComposite(LayerStack& stack)
+{
+	for (const std::unique_ptr<FieldLayer>& layer : stack.layers)
+	{
+		resetFieldTileCache(layer->compositeSource, layer->field);
+	}
+}
+
+void resolveLayers(LayerStack& stack, const FieldRect& rect, JobSystem* jobs, FrameArena* arena)
+{
+	for (const std::unique_ptr<FieldLayer>& layer : stack.layers)
+	{
+		resolveMultiresField(layer->detail, rect, jobs, arena);
+	}
+}
+
+void resolveLayers(LayerStack& stack, JobSystem* jobs, FrameArena* arena)
+{
+	FieldRect rect = { 0, 0, stack.width, stack.height };
+	resolveLayers(stack, rect, jobs, arena);
+}
+
+static Vec2 blendLayer(Vec2 result, Vec2 value, LayerBlendMode mode, float opacity)
+{
+	switch (mode)
+	{
+	case LayerBlendMode::Add:
+		return result + value * opacity;
+	case LayerBlendMode::Replace:
+		return lerp(result, value, opacity);
+	case LayerBlendMode::NormalizeAdd:
+	{
+		static constexpr float smallNumber = 0.00001f;
+		const Vec2 weighted = value * opacity;
+		const Vec2 sum = result + weighted;
+		const float sumLength = sum.length();
+		if (sumLength < smallNumber) return Vec2(0.0f);
+		return sum * (max(result.length(), weighted.length()) / sumLength);
+	}
+	default:
+		return result;
+	}
+}
+
+static void compositeTile(LayerStack& stack, const FieldRect& rect)
+{
+	VectorField& composite = stack.composite;
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		Vec2* out = composite.data + y * composite.width;
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			out[x] = Vec2(0.0f);
+		}
+
+		for (const std::unique_ptr<FieldLayer>& layer : stack.layers)
+		{
+			if (!layer->visible) continue;
+
+			const Vec2* in = layer->field.data + y * composite.width;
+			const float opacity = layer->opacity;
+			const LayerBlendMode mode = layer->blendMode;
+
+			for (u32 x = rect.x0; x < rect.x1; ++x)
+			{
+				out[x] = blendLayer(out[x], in[x], mode, opacity);
+			}
+		}
+	}
+}
+
+u32 updateLayerComposite(LayerStack& stack, JobSystem* jobs, FrameArena* arena)
+{
+	VectorField& composite = stack.composite;
+	const u32 tileCount = u32(composite.tileRevisions.size());
+
+	// Gather dirty tiles on the calling thread, checking revisions is far cheaper than blending.
+	// A tile is dirty when it changed in any layer.
+	FrameArray<u32> dirtyTiles(arena, tileCount);
+	memset(dirtyTiles.data, 0, sizeof(u32) * tileCount);
+	for (const std::unique_ptr<FieldLayer>& layer : stack.layers)
+	{
+		if (layer->compositeSource.field != &layer->field || layer->compositeSource.revisions.size() != tileCount)
+		{
+			resetFieldTileCache(layer->compositeSource, layer->field);
+		}
+
+		flagDirtyTiles(layer->compositeSource, layer->field, 0, dirtyTiles.data);
+	}
+
+	const u32 dirtyCount = compactDirtyTiles(dirtyTiles.data, tileCount);
+
+	parallelFor(jobs, dirtyCount, 4, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			compositeTile(stack, getTileRect(composite, dirtyTiles[i]));
+		}
+	});
+
+	if (dirtyCount)
+	{
+		const u32 revision = ++composite.revision;
+		for (u32 i = 0; i < dirtyCount; ++i)
+		{
+			composite.tileRevisions[dirtyTiles[i]] = revision;
+		}
+	}
+
+	return dirtyCount;
+}
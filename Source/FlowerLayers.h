@@ -0,0 +1,66 @@
+#pragma once
+
+#include "FlowerField.h"
+#include "FlowerMultires.h"
+
+#include <memory>
+#include <vector>
+
+enum class LayerBlendMode : u32
+{
+	Add,          // result + layer * opacity
+	Replace,      // lerp(result, layer, opacity)
+	NormalizeAdd, // direction of the sum, length of the longer input, so directions blend without gaining strength
+	Count
+};
+
+struct FieldLayer
+{
+	VectorField field;
+
+	// Brushes go through the multires representation of the field, which has to be resolved
+	// before the field is read or written directly
+	MultiresField detail;
+
+	float opacity = 1.0f;
+	LayerBlendMode blendMode = LayerBlendMode::Add;
+	bool visible = true;
+
+	// Tile revisions of the field seen by the composite
+	FieldTileCache compositeSource;
+};
+
+// Non-destructive editing: brushes write into the active layer and the flattened composite is what
+// gets sampled, drawn and exported. The composite is cached per tile and only tiles whose layer
+// revisions changed since the last update are recomposited.
+struct LayerStack
+{
+	u32 width = 0;
+	u32 height = 0;
+
+	std::vector<std::unique_ptr<FieldLayer>> layers;
+	u32 activeLayer = 0;
+
+	// Shared by all layers, blocked cells are locked in every layer
+	ObstacleMask obstacles;
+
+	VectorField composite;
+};
+
+void createLayerStack(LayerStack& stack, u32 width, u32 height);
+
+// Adds a zero layer above the active one and makes it active
+u32 addLayer(LayerStack& stack, LayerBlendMode blendMode = LayerBlendMode::Add, float opacity = 1.0f);
+void removeLayer(LayerStack& stack, u32 layerIndex);
+
+FieldLayer& getActiveLayer(LayerStack& stack);
+
+// Must be called after changing layer order or properties (opacity, blend mode, visibility)
+void invalidateLayerComposite(LayerStack& stack);
+
+// Brings the given cells of every layer up to date with their multires detail
+void resolveLayers(LayerStack& stack, const FieldRect& rect, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+void resolveLayers(LayerStack& stack, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+
+// Recomposites tiles changed in any layer since the previous update. Returns the number of recomposited tiles.
+u32 updateLayerComposite(LayerStack& stack, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
@@ -3,143 +3,245 @@
 #include <Rush/GfxRef.h>
 #include <Rush/Platform.h>
 #include <Rush/Window.h>
+#include <Rush/UtilLog.h>
 #include <Rush/UtilRandom.h>
 #include <Rush/UtilTimer.h>
 
-struct VectorField
+#include "FlowerArena.h"
+#include "FlowerDensity.h"
+#include "FlowerDerived.h"
+#include "FlowerDistance.h"
+#include "FlowerField.h"
+#include "FlowerFluid.h"
+#include "FlowerHeightmap.h"
+#include "FlowerImage.h"
+#include "FlowerJobs.h"
+#include "FlowerLayers.h"
+#include "FlowerPreview.h"
+#include "FlowerNoise.h"
+#include "FlowerSequence.h"
+#include "FlowerSpline.h"
+#include "FlowerStats.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Particles
 {
-	static constexpr u32 width  = 512;
-	static constexpr u32 height = 512;
-	static constexpr u32 count  = width * height;
+	static constexpr u32 count = 150000;
 
-	Vec2 data[count];
+	Vec2 pos[count];
+	Vec2 vel[count];
+	u32  life[count];
 };
 
-static void initVectorField(VectorField& vf, const Vec2& value)
+static void initParticles(Particles& p, Rand& rng)
 {
-	for (Vec2& it : vf.data)
+	for (u32 i = 0; i < p.count; ++i)
 	{
-		it = value;
+		p.pos[i] = Vec2(rng.getFloat(0, 1), rng.getFloat(0, 1));
+		p.vel[i] = 0.0f;
+		p.life[i] = 0;
 	}
 }
 
-static const Vec2& sample(const VectorField& vf, const Vec2& uv)
+// Region of the field where particles live, in field coordinates. It follows the visible part of the field,
+// so a fixed particle budget keeps the same density on screen at any zoom level and field size.
+struct ParticleDomain
 {
-	u32 ix = (u32)(uv.x*vf.width) % vf.width;
-	u32 iy = (u32)(uv.y*vf.height) % vf.height;
-	return vf.data[ix + iy * vf.width];
-}
+	Vec2 min = Vec2(0.0f);
+	Vec2 max = Vec2(1.0f);
 
-static void dampen(VectorField& vf, const Vec2& brushPos, float brushRadius)
+	// Field units per window width, motion is scaled by it to look the same at any zoom level
+	float scale = 1.0f;
+};
+
+// Simulation of one frame reads the previous particle state and writes the next one,
+// which lets rendering of the previous state overlap with it.
+struct ParticleSimulation
 {
-	for (u32 y = 0; y < vf.height; ++y)
-	{
-		for (u32 x = 0; x < vf.width; ++x)
-		{
-			Vec2 p = Vec2((float)x, (float)y) / Vec2((float)vf.width, (float)vf.height);
-			Vec2 delta = (p - brushPos);
-			Vec2 absDelta(fabs(delta.x), fabs(delta.y));
-			if (absDelta.x <= brushRadius && absDelta.y <= brushRadius)
-			{
-				Vec2& v = vf.data[x + y * vf.width];
-				Vec2 forceDir = absDelta / brushRadius;
-				float forceLen = min(1.0f, forceDir.length());
-				v = lerp(v * 0.8f, v, forceLen);
-			}
-		}
-	}
-}
+	const Particles* src = nullptr;
+	Particles* dst = nullptr;
+	const VectorField* vf = nullptr;
+	const ObstacleMask* obstacles = nullptr;
+	ParticleDomain domain;
+	u32 frameSeed = 0;
+
+	JobCounter counter;
+	bool inFlight = false;
+};
 
-static void comb(VectorField& vf, const Vec2& brushPrev, const Vec2& brushCur, float brushRadius)
+static void updateParticles(void* userData, u32 begin, u32 end)
 {
-	Vec2 stroke = brushCur - brushPrev;
-	float strokeLength = stroke.length();
+	const ParticleSimulation& sim = *reinterpret_cast<const ParticleSimulation*>(userData);
+	const Particles& src = *sim.src;
+	Particles& dst = *sim.dst;
+	const VectorField& vf = *sim.vf;
+	const ParticleDomain& domain = sim.domain;
+	const ObstacleMask* obstacles = sim.obstacles;
+
+	float forceScale = 0.002f * domain.scale;
+	float friction = 0.1f;
 
-	const float strokeThreshold = 0.0001f;
-	if (strokeLength <= strokeThreshold) return;
+	// Each batch gets its own generator so that batches can run on any thread
+	Rand rng(sim.frameSeed ^ (begin * 0x9E3779B9));
 
-	const float strokeWeight = pow(strokeLength, 1.8f);
+	for (u32 i = begin; i < end; ++i)
+	{
+		Vec2 pos = src.pos[i];
+		Vec2 vel = src.vel[i];
+		u32 life = src.life[i];
 
-	Vec2 strokeDir = stroke / strokeLength;
+		Vec2 force = 0.0f;
 
-	for (u32 y = 0; y < vf.height; ++y)
-	{
-		for (u32 x = 0; x < vf.width; ++x)
+		// Particles leaving the domain are recycled into it instead of being simulated off screen
+		bool inside =
+			pos.x > domain.min.x && pos.x < domain.max.x &&
+			pos.y > domain.min.y && pos.y < domain.max.y;
+
+		// Particles that ran into an obstacle are recycled as well
+		if (inside && obstacles)
 		{
-			Vec2 p = Vec2((float)x, (float)y) / Vec2((float)vf.width, (float)vf.height);
-			Vec2 delta = (p - brushCur);
-			Vec2 absDelta(fabs(delta.x), fabs(delta.y));
+			inside = !isBlocked(*obstacles, u32(pos.x * obstacles->width), u32(pos.y * obstacles->height));
+		}
 
-			if (absDelta.x <= brushRadius && absDelta.y <= brushRadius)
-			{
-				Vec2& v = vf.data[x + y * vf.width];
+		if (inside)
+		{
+			force = sample(vf, pos) * forceScale;
+		}
 
-				Vec2 forceDir = absDelta / brushRadius;
+		pos += vel;
 
-				float forceLen = min(1.0f, forceDir.length());
+		vel *= friction;
+		vel += force;
 
-				float combWeight = (1.0f - forceLen) * strokeWeight * (150.0f / (4.0f*brushRadius));
+		if (life == 0 || !inside)
+		{
+			pos = Vec2(rng.getFloat(domain.min.x, domain.max.x), rng.getFloat(domain.min.y, domain.max.y));
+			vel = sample(vf, pos) * forceScale;
+			life = rng.getUint(0, 80);
+		}
+		else
+		{
+			--life;
+		}
 
-				v += strokeDir * combWeight;
+		dst.pos[i] = pos;
+		dst.vel[i] = vel;
+		dst.life[i] = life;
+	}
+}
 
-				float vLength = v.length();
-				if (vLength > 1.0f)
-				{
-					v /= vLength;
-				}
-			}
-		}
+static void beginUpdateParticles(ParticleSimulation& sim, const Particles& src, Particles& dst, const VectorField& vf,
+	const ObstacleMask* obstacles, const ParticleDomain& domain, Rand& rng, JobSystem* jobs)
+{
+	RUSH_ASSERT(!sim.inFlight);
+
+	sim.src = &src;
+	sim.dst = &dst;
+	sim.vf = &vf;
+	sim.obstacles = obstacles;
+	sim.domain = domain;
+	sim.frameSeed = rng.getUint(0, 0xFFFFFFFF);
+	sim.inFlight = true;
+
+	const u32 particlesPerJob = 4096;
+	submitJobRange(jobs, updateParticles, &sim, src.count, particlesPerJob, sim.counter);
+}
+
+static void finishUpdateParticles(ParticleSimulation& sim, JobSystem* jobs)
+{
+	if (!sim.inFlight) return;
+
+	if (jobs)
+	{
+		waitForCounter(*jobs, sim.counter);
 	}
+
+	sim.inFlight = false;
 }
 
-struct Particles
+struct Camera
 {
-	static constexpr u32 count = 150000;
+	// Field coordinates at the middle of the window
+	Vec2 center = Vec2(0.5f);
 
-	Vec2 pos[count];
-	Vec2 vel[count];
-	u32  life[count];
+	// Window widths per field width
+	float zoom = 1.0f;
 };
 
-static void initParticles(Particles& p, Rand& rng)
+// Maps field coordinates to window pixels as pos * scale + offset
+struct ViewTransform
 {
-	for (u32 i = 0; i < p.count; ++i)
-	{
-		p.pos[i] = Vec2(rng.getFloat(0, 1), rng.getFloat(0, 1));
-		p.vel[i] = 0.0f;
-		p.life[i] = 0;
-	}
+	Vec2 scale = Vec2(1.0f);
+	Vec2 offset = Vec2(0.0f);
+	Vec2 dimensions = Vec2(1.0f);
+
+	// Field coordinates of the window corners
+	Vec2 visibleMin = Vec2(0.0f);
+	Vec2 visibleMax = Vec2(1.0f);
+};
+
+static ViewTransform makeViewTransform(const Camera& camera, Vec2 visualDimensions)
+{
+	ViewTransform view;
+	view.scale = visualDimensions * camera.zoom;
+	view.offset = visualDimensions * 0.5f - camera.center * view.scale;
+	view.dimensions = visualDimensions;
+	view.visibleMin = -view.offset / view.scale;
+	view.visibleMax = (visualDimensions - view.offset) / view.scale;
+	return view;
 }
 
-static void updateParticles(Particles& p, const VectorField& vf, Rand& rng)
+static Vec2 fieldToScreen(const ViewTransform& view, Vec2 pos)
 {
-	float forceScale = 0.002f;
-	float friction = 0.1f;
-	for (u32 i = 0; i < p.count; ++i)
-	{
-		Vec2 force = 0.0f;
+	return pos * view.scale + view.offset;
+}
 
-		if (p.pos[i].x > 0 && p.pos[i].x < 1 &&
-			p.pos[i].y > 0 && p.pos[i].y < 1)
-		{
-			force = sample(vf, p.pos[i]) * forceScale;
-		}
+static Vec2 screenToField(const ViewTransform& view, Vec2 pos)
+{
+	return (pos - view.offset) / view.scale;
+}
 
-		p.pos[i] += p.vel[i];
+static bool isVisible(const ViewTransform& view, Vec2 screenPos, float margin)
+{
+	return screenPos.x >= -margin && screenPos.y >= -margin &&
+		screenPos.x <= view.dimensions.x + margin && screenPos.y <= view.dimensions.y + margin;
+}
 
-		p.vel[i] *= friction;
-		p.vel[i] += force;
+static ParticleDomain getParticleDomain(const ViewTransform& view)
+{
+	ParticleDomain domain;
+	domain.min.x = clamp(view.visibleMin.x, 0.0f, 1.0f);
+	domain.min.y = clamp(view.visibleMin.y, 0.0f, 1.0f);
+	domain.max.x = clamp(view.visibleMax.x, 0.0f, 1.0f);
+	domain.max.y = clamp(view.visibleMax.y, 0.0f, 1.0f);
+	domain.scale = view.dimensions.x / view.scale.x;
+	return domain;
+}
 
-		if (p.life[i] == 0)
-		{
-			p.pos[i] = Vec2(rng.getFloat(0, 1), rng.getFloat(0, 1));
-			p.vel[i] = sample(vf, p.pos[i]) * forceScale;
-			p.life[i] += rng.getUint(0, 80);
-		}
-		else
-		{
-			--p.life[i];
-		}
+static FieldRect getVisibleFieldRect(const ViewTransform& view, u32 width, u32 height)
+{
+	const Vec2 dimensions = Vec2(float(width), float(height));
+	const Vec2 visibleMin = view.visibleMin * dimensions;
+	const Vec2 visibleMax = view.visibleMax * dimensions;
+
+	FieldRect rect;
+	rect.x0 = u32(clamp(floorf(visibleMin.x), 0.0f, dimensions.x));
+	rect.y0 = u32(clamp(floorf(visibleMin.y), 0.0f, dimensions.y));
+	rect.x1 = u32(clamp(ceilf(visibleMax.x), 0.0f, dimensions.x));
+	rect.y1 = u32(clamp(ceilf(visibleMax.y), 0.0f, dimensions.y));
+	return rect;
+}
+
+static void drawSplinePoints(PrimitiveBatch* prim, const FlowSpline& spline, const ViewTransform& view)
+{
+	for (size_t i = 1; i < spline.points.size(); ++i)
+	{
+		const Vec2 a = fieldToScreen(view, spline.points[i - 1]);
+		const Vec2 b = fieldToScreen(view, spline.points[i]);
+		prim->drawLine(Line2(a, b), ColorRGBA8(255, 200, 64));
 	}
 }
 
@@ -161,16 +263,128 @@ static void drawBrush(PrimitiveBatch* prim, Vec2 brushPos, float brushRadius)
 	}
 }
 
+// Snapshot of the field that is encoded and written on a background worker
+struct FlowmapExport
+{
+	VectorField field;
+	const char* path = nullptr;
+};
+
+static void exportFlowmapJob(void* userData, u32, u32)
+{
+	FlowmapExport* job = reinterpret_cast<FlowmapExport*>(userData);
+
+	u8* pixels = new u8[job->field.count * 4];
+	exportFlowmap(job->field, pixels, job->field.width * 4);
+
+	if (!saveTga(job->path, job->field.width, job->field.height, pixels))
+	{
+		RUSH_LOG_ERROR("Failed to save flowmap to %s", job->path);
+	}
+
+	delete[] pixels;
+	delete job;
+}
+
+struct FrameTimeStats
+{
+	bool enabled = false;
+	u64 lastFrameTime = 0;
+	u32 frameCount = 0;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	double maximum = 0.0;
+};
+
+// Image rendered on the CPU and shown as a texture. The texture is created once per size and updated in place
+// when the pixels change, so images that change every frame don't create a texture per frame.
+struct GpuImage
+{
+	GfxTextureRef texture;
+	u32 width = 0;
+	u32 height = 0;
+};
+
 struct State
 {
 	Timer timer;
 	Rand rng;
-	VectorField vectorField;
-	Particles particles;
+	JobSystemDesc jobSystemDesc;
+	JobSystem jobSystem;
+	FrameArena frameArena;
+
+	// Edits go into the active layer, everything else reads the flattened composite
+	LayerStack layers;
+
+	// When enabled, the field advects itself as a fluid every frame and brush strokes act as forces
+	bool fluidMode = false;
+	FluidSettings fluidSettings;
+	FluidSolver fluidSolver;
+
+	CurlNoiseSettings curlNoiseSettings;
+
+	// I replaces the active layer with the downhill flow of a terrain heightmap, loaded on first use
+	const char* heightmapPath = nullptr;
+	Heightmap heightmap;
+	HeightmapFlowSettings heightmapFlowSettings;
+
+	// R bends the flow of the active layer around the obstacles
+	ObstacleFlowSettings obstacleFlowSettings;
+	ObstacleDistanceField obstacleDistance;
+
+	// Keyframes are captured into an animated sequence and played back through a separate field
+	SequenceWriter sequenceWriter;
+	u32 sequenceKeyframeCount = 0;
+	SequencePlayer sequencePlayer;
+	VectorField playbackField;
+	bool playingSequence = false;
+	u64 playbackStartTime = 0;
+
+	// Texture distorted by the display field, rendered on the CPU and uploaded every frame while shown
+	const char* previewTexturePath = nullptr;
+	u32 previewSize = 1024;
+	PreviewTexture previewTexture;
+	FlowPreview flowPreview;
+	FlowPreviewSettings flowPreviewSettings;
+	GpuImage previewImage;
+	bool showPreview = false;
+
+	// V starts recording a spline, left clicks add control points, V again writes it into the active layer
+	FlowSpline pendingSpline;
+	bool recordingSpline = false;
+	bool mouseLeftPrev = false;
+
+	// D shows where the particles gather, as a density image over the particle domain
+	DensityGrid densityGrid;
+	GpuImage densityImage;
+	float densityDecay = 0.9f;
+	bool showDensity = false;
+
+	// M cycles through divergence, curl and magnitude overlays of the display field, recomputed only where it changed
+	FieldDerivedMaps derivedMaps;
+	GpuImage derivedImage;
+	u32 derivedOverlay = 0; // 0 is off, otherwise FieldQuantity + 1
+	u32 derivedImageQuantity = ~0u;
+
+	// Particles are double buffered: the front buffer is drawn while the next frame is simulated into the back buffer
+	Particles particles[2];
+	u32 particlesFront = 0;
+	ParticleSimulation particleSimulation;
 	PrimitiveBatch* primitiveBatch = nullptr;
 
 	Vec2 visualDimensions = Vec2(1.0f);
 
+	// Ctrl + wheel zooms around the cursor, middle mouse button drag pans, Z resets the view
+	Camera camera;
+	ViewTransform view;
+	Vec2 mousePosPrev = Vec2(0.0f);
+
+	// Coarser levels of the display field, for drawing zoomed out views
+	FieldMipChain displayFieldMips;
+
+	// Kept up to date every frame, H logs them
+	FieldStats displayFieldStats;
+
 	Vec2 brushPos = Vec2(0.5f);
 	Vec2 brushPosPrev = brushPos;
 	float brushRadius = 0.1f;
@@ -185,11 +399,24 @@ struct State
 	bool showField = false;
 	bool showBrush = true;
 
+	bool keysDown[512] = {};
+
+	FrameTimeStats frameTimeStats;
+
 	u64 lastMouseActivityTime = 0;
 };
 
+// Field that particles follow and that is visualized
+static const VectorField& getDisplayField(const State* state)
+{
+	return state->playingSequence ? state->playbackField : state->layers.composite;
+}
+
 static void startup(State* state)
 {
+	startJobSystem(state->jobSystem, state->jobSystemDesc);
+	createFrameArena(state->frameArena, &state->jobSystem, 256 * 1024);
+
 	state->primitiveBatch = new PrimitiveBatch();
 
 	state->blendLerp.takeover(Gfx_CreateBlendState(GfxBlendStateDesc::makeLerp()));
@@ -198,12 +425,31 @@ static void startup(State* state)
 	additiveDesc.src = GfxBlendParam::SrcAlpha;
 	state->blendAdd.takeover(Gfx_CreateBlendState(additiveDesc));
 
-	initVectorField(state->vectorField, Vec2(0.0f));
-	initParticles(state->particles, state->rng);
+	createLayerStack(state->layers, 512, 512);
+	createDensityGrid(state->densityGrid, 256, 256, &state->jobSystem);
+
+	if (!state->previewTexturePath || !loadPreviewTexture(state->previewTexture, state->previewTexturePath))
+	{
+		if (state->previewTexturePath)
+		{
+			RUSH_LOG_ERROR("Failed to load preview texture %s", state->previewTexturePath);
+		}
+		createCheckerboardTexture(state->previewTexture, 256, 32);
+	}
+	initParticles(state->particles[state->particlesFront], state->rng);
 }
 
 static void shutdown(State* state)
 {
+	finishUpdateParticles(state->particleSimulation, &state->jobSystem);
+	closeSequence(state->sequencePlayer);
+	if (state->sequenceKeyframeCount)
+	{
+		finishSequence(state->sequenceWriter);
+	}
+	destroyFrameArena(state->frameArena);
+	stopJobSystem(state->jobSystem);
+
 	delete state->primitiveBatch;
 	delete state;
 }
@@ -245,78 +491,300 @@ static ColorRGBA8 dirToColor(Vec2 dir, float saturation = 1.0f, float brightness
 	return hsvToRgb(at, saturation, brightness);
 }
 
-static void drawParticles(PrimitiveBatch* prim, const Particles& particles, Vec2 visualDimensions)
+static void drawParticles(PrimitiveBatch* prim, const Particles& particles, const ViewTransform& view, FrameArena& arena, JobSystem* jobs)
 {
-	const u32 particleCount = RUSH_COUNTOF(particles.pos);
+	// Trails are a few pixels long, particles just outside the window may still reach into it
+	const float cullMargin = 16.0f;
+
+	// Culling is a single compare per particle, cheap enough to compact the visible set serially
+	u32* visible = allocateFrame<u32>(arena, particles.count);
+	u32 visibleCount = 0;
+	for (u32 i = 0; i < particles.count; ++i)
+	{
+		visible[visibleCount] = i;
+		visibleCount += isVisible(view, fieldToScreen(view, particles.pos[i]), cullMargin);
+	}
+
 	const u32 maxVerticesPerBatch = prim->getMaxBatchVertices();
 	const u32 particlesPerBatch = maxVerticesPerBatch / 2;
-	const u32 batchCount = divUp(particleCount, particlesPerBatch);
+	const u32 batchCount = divUp(visibleCount, particlesPerBatch);
 
 	for (u32 batchId = 0; batchId < batchCount; ++batchId)
 	{
 		const u32 firstIndex = batchId * particlesPerBatch;
-		const u32 lastIndex  = min(firstIndex + particlesPerBatch, particleCount);
+		const u32 lastIndex  = min(firstIndex + particlesPerBatch, visibleCount);
 		const u32 batchParticleCount = lastIndex - firstIndex;
 		const u32 batchVertexCount = batchParticleCount * 2;
 
 		PrimitiveBatch::BatchVertex* vertices = prim->drawVertices(GfxPrimitive::LineList, batchVertexCount);
 
-		for (u32 i = 0; i < batchParticleCount; ++i)
+		parallelFor(jobs, batchParticleCount, 2048, [&](u32 begin, u32 end)
 		{
-			u32 particleId = firstIndex + i;
-			Vec2 pos = particles.pos[particleId] * visualDimensions;
-			Vec2 dir = particles.vel[particleId] * visualDimensions;
+			for (u32 i = begin; i < end; ++i)
+			{
+				u32 particleId = visible[firstIndex + i];
+				Vec2 pos = fieldToScreen(view, particles.pos[particleId]);
+				Vec2 dir = particles.vel[particleId] * view.scale;
 
-			dir *= 6.0f;
+				dir *= 6.0f;
 
-			if (fabs(dir.x) < 1.0f && fabs(dir.y) <= 1.0f) dir.y = -1.0f;
+				if (fabs(dir.x) < 1.0f && fabs(dir.y) <= 1.0f) dir.y = -1.0f;
 
-			Line2 line(pos, pos - dir);
+				Line2 line(pos, pos - dir);
 
-			ColorRGBA8 color = dirToColor(normalize(dir), 0.2f, 0.3f);
+				ColorRGBA8 color = dirToColor(normalize(dir), 0.2f, 0.3f);
 
-			ColorRGBA8 colorStart = color; colorStart.a = 115;
-			ColorRGBA8 colorEnd = color; colorEnd.a = 0;
+				ColorRGBA8 colorStart = color; colorStart.a = 115;
+				ColorRGBA8 colorEnd = color; colorEnd.a = 0;
 
-			vertices[i * 2 + 0].pos = Vec3(line.start.x, line.start.y, 0.0f);
-			vertices[i * 2 + 0].tex = Vec2(0.0f);
-			vertices[i * 2 + 0].col = colorStart;
+				vertices[i * 2 + 0].pos = Vec3(line.start.x, line.start.y, 0.0f);
+				vertices[i * 2 + 0].tex = Vec2(0.0f);
+				vertices[i * 2 + 0].col = colorStart;
 
-			vertices[i * 2 + 1].pos = Vec3(line.end.x, line.end.y, 0.0f);
-			vertices[i * 2 + 1].tex = Vec2(0.0f);
-			vertices[i * 2 + 1].col = colorEnd;
-		}
+				vertices[i * 2 + 1].pos = Vec3(line.end.x, line.end.y, 0.0f);
+				vertices[i * 2 + 1].tex = Vec2(0.0f);
+				vertices[i * 2 + 1].col = colorEnd;
+			}
+		});
 	}
 }
 
-static void drawField(PrimitiveBatch* prim, const VectorField& vf, const Vec2 visualDimensions)
+static void drawField(PrimitiveBatch* prim, const FieldMipChain& mips, const VectorField& source, const ViewTransform& view,
+	const FieldStats& stats, JobSystem* jobs)
 {
+	// Colors and line lengths are relative to the magnitude of most of the field, so weak and strong fields both read well
+	const float smallNumber = 0.00001f;
+	const float invReferenceMagnitude = 1.0f / max(smallNumber, getMagnitudePercentile(stats, 0.95f));
+
+	// Coarsest detail that keeps cells at least this many pixels apart, so line count tracks the window size
+	const float minCellPixels = 4.0f;
+
+	u32 level = 0;
+	const u32 levelCount = getFieldLevelCount(mips);
+	while (level + 1 < levelCount && view.scale.x / float(getFieldLevel(mips, source, level).width) < minCellPixels)
+	{
+		++level;
+	}
+
+	const VectorField& vf = getFieldLevel(mips, source, level);
+
 	Vec2 fieldDimensions = Vec2(float(vf.width), float(vf.height));
 
-	Vec2 cellSize = visualDimensions / fieldDimensions;
+	Vec2 cellSize = view.scale / fieldDimensions;
 	Vec2 cellHalfSize = cellSize * 0.5f;
 
-	for (u32 y = 0; y < vf.height; ++y)
+	const Vec2 visibleMin = view.visibleMin * fieldDimensions;
+	const Vec2 visibleMax = view.visibleMax * fieldDimensions;
+
+	const u32 x0 = u32(clamp(floorf(visibleMin.x), 0.0f, fieldDimensions.x));
+	const u32 y0 = u32(clamp(floorf(visibleMin.y), 0.0f, fieldDimensions.y));
+	const u32 x1 = u32(clamp(ceilf(visibleMax.x), 0.0f, fieldDimensions.x));
+	const u32 y1 = u32(clamp(ceilf(visibleMax.y), 0.0f, fieldDimensions.y));
+
+	if (x0 >= x1 || y0 >= y1) return;
+
+	const u32 visibleWidth = x1 - x0;
+	const u32 rowsPerBatch = max(1u, prim->getMaxBatchVertices() / (visibleWidth * 2));
+	const u32 batchCount = divUp(y1 - y0, rowsPerBatch);
+
+	for (u32 batchId = 0; batchId < batchCount; ++batchId)
 	{
-		for (u32 x = 0; x < vf.width; ++x)
+		const u32 firstRow = y0 + batchId * rowsPerBatch;
+		const u32 lastRow = min(firstRow + rowsPerBatch, y1);
+
+		PrimitiveBatch::BatchVertex* vertices = prim->drawVertices(GfxPrimitive::LineList, (lastRow - firstRow) * visibleWidth * 2);
+
+		parallelFor(jobs, lastRow - firstRow, 8, [&](u32 rowBegin, u32 rowEnd)
 		{
-			Vec2 dir = vf.data[x + vf.width * y];
-			Vec2 pos = cellHalfSize + cellSize * Vec2((float)x, (float)y);
+			for (u32 row = rowBegin; row < rowEnd; ++row)
+			{
+				const u32 y = firstRow + row;
+				for (u32 x = x0; x < x1; ++x)
+				{
+					Vec2 dir = vf.data[x + vf.width * y];
+					Vec2 pos = view.offset + cellHalfSize + cellSize * Vec2((float)x, (float)y);
+
+					float dirLength = dir.length();
+					float relativeLength = dirLength * invReferenceMagnitude;
+
+					ColorRGBA8 color = dirToColor(dir / dirLength, min(1.0f, relativeLength) * 0.9f, min(1.0f, relativeLength * 2.0f));
+
+					dirLength = min(2.0f, relativeLength * 2.0f);
 
-			float dirLength = dir.length();
+					Line2 line(pos, pos + normalize(dir) * dirLength * cellSize);
+
+					ColorRGBA8 colorStart = color; colorStart.a = 100;
+					ColorRGBA8 colorEnd = color; colorEnd.a = 0;
+
+					PrimitiveBatch::BatchVertex* v = vertices + (row * visibleWidth + x - x0) * 2;
+
+					v[0].pos = Vec3(line.start.x, line.start.y, 0.0f);
+					v[0].tex = Vec2(0.0f);
+					v[0].col = colorStart;
+
+					v[1].pos = Vec3(line.end.x, line.end.y, 0.0f);
+					v[1].tex = Vec2(0.0f);
+					v[1].col = colorEnd;
+				}
+			}
+		});
+	}
+}
 
-			ColorRGBA8 color = dirToColor(dir / dirLength, dirLength * 0.9f, min(1.0f, dirLength*5.0f));
+static void drawObstacles(PrimitiveBatch* prim, const ObstacleMask& mask, const ViewTransform& view, FrameArena& arena)
+{
+	const FieldRect visible = getVisibleFieldRect(view, mask.width, mask.height);
+	if (visible.empty()) return;
 
-			dirLength = min(2.0f, dirLength*20.0f);
+	const Vec2 cellSize = view.scale / Vec2(float(mask.width), float(mask.height));
+	const ColorRGBA8 color(90, 40, 30, 200);
 
-			Line2 line(pos, pos + normalize(dir) * dirLength * cellSize);
+	// Blocked tiles are drawn whole, mixed tiles as one quad per run of blocked cells in a row
+	const u32 maxRunCount = 1 << 14;
+	FieldRect* runs = allocateFrame<FieldRect>(arena, maxRunCount);
+	u32 runCount = 0;
 
-			ColorRGBA8 colorStart = color; colorStart.a = 100;
-			ColorRGBA8 colorEnd = color; colorEnd.a = 0;
+	const u32 tileSize = VectorField::tileSize;
+	for (u32 ty = visible.y0 / tileSize; ty < divUp(visible.y1, tileSize); ++ty)
+	{
+		for (u32 tx = visible.x0 / tileSize; tx < divUp(visible.x1, tileSize) && runCount < maxRunCount; ++tx)
+		{
+			const ObstacleTileState tileState = getObstacleTileState(&mask, tx, ty);
+			const u32 x0 = tx * tileSize;
+			const u32 y0 = ty * tileSize;
+			const u32 x1 = min(x0 + tileSize, mask.width);
+			const u32 y1 = min(y0 + tileSize, mask.height);
 
-			prim->drawLine(line, colorStart, colorEnd);
+			if (tileState == ObstacleTileState::Blocked)
+			{
+				runs[runCount++] = { x0, y0, x1, y1 };
+			}
+			else if (tileState == ObstacleTileState::Mixed)
+			{
+				for (u32 y = y0; y < y1 && runCount < maxRunCount; ++y)
+				{
+					const u32 bits = getObstacleBits(mask, tx, y);
+					const u32 columnCount = x1 - x0;
+					for (u32 x = 0; x < columnCount && runCount < maxRunCount;)
+					{
+						if (!((bits >> x) & 1))
+						{
+							++x;
+							continue;
+						}
+
+						u32 runEnd = x;
+						while (runEnd < columnCount && ((bits >> runEnd) & 1)) ++runEnd;
+
+						runs[runCount++] = { x0 + x, y, x0 + runEnd, y + 1 };
+						x = runEnd;
+					}
+				}
+			}
 		}
 	}
+
+	const u32 quadsPerBatch = prim->getMaxBatchVertices() / 6;
+	for (u32 firstRun = 0; firstRun < runCount; firstRun += quadsPerBatch)
+	{
+		const u32 batchRunCount = min(quadsPerBatch, runCount - firstRun);
+		PrimitiveBatch::BatchVertex* vertices = prim->drawVertices(GfxPrimitive::TriangleList, batchRunCount * 6);
+
+		for (u32 i = 0; i < batchRunCount; ++i)
+		{
+			const FieldRect& run = runs[firstRun + i];
+			const Vec2 a = view.offset + cellSize * Vec2(float(run.x0), float(run.y0));
+			const Vec2 b = view.offset + cellSize * Vec2(float(run.x1), float(run.y1));
+			const Vec2 corners[] = { a, Vec2(b.x, a.y), b, a, b, Vec2(a.x, b.y) };
+
+			for (u32 j = 0; j < 6; ++j)
+			{
+				vertices[i * 6 + j].pos = Vec3(corners[j].x, corners[j].y, 0.0f);
+				vertices[i * 6 + j].tex = Vec2(0.0f);
+				vertices[i * 6 + j].col = color;
+			}
+		}
+	}
+}
+
+// Replaces the image with tightly packed RGBA8 pixels. Must be called outside of passes.
+static void uploadImage(GfxContext* ctx, GpuImage& image, u32 width, u32 height, const u32* pixels)
+{
+	GfxTextureData textureData(pixels);
+
+	if (image.width == width && image.height == height)
+	{
+		Gfx_UpdateTexture(ctx, image.texture.get(), textureData);
+		return;
+	}
+
+	GfxTextureDesc textureDesc = GfxTextureDesc::make2D(width, height, GfxFormat_RGBA8_Unorm);
+	image.texture.takeover(Gfx_CreateTexture(textureDesc, &textureData, 1));
+	image.width = width;
+	image.height = height;
+}
+
+// Draws the texture stretched over [fieldMin, fieldMax] in field coordinates
+static void drawFieldImage(PrimitiveBatch* prim, const GfxTextureRef& texture, const ViewTransform& view, Vec2 fieldMin, Vec2 fieldMax)
+{
+	prim->setTexture(texture.get());
+
+	const Vec2 corners[] = { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 1.0f) };
+
+	PrimitiveBatch::BatchVertex* vertices = prim->drawVertices(GfxPrimitive::TriangleList, RUSH_COUNTOF(corners));
+	for (u32 i = 0; i < RUSH_COUNTOF(corners); ++i)
+	{
+		const Vec2 pos = fieldToScreen(view, fieldMin + (fieldMax - fieldMin) * corners[i]);
+		vertices[i].pos = Vec3(pos.x, pos.y, 0.0f);
+		vertices[i].tex = corners[i];
+		vertices[i].col = ColorRGBA8::White();
+	}
+
+	prim->flush();
+	prim->setTexture(GfxTexture());
+}
+
+static void updateFlowPreview(State* state, GfxContext* ctx)
+{
+	const float time = float(state->timer.microTime()) * 1e-6f;
+	FlowPreview& preview = state->flowPreview;
+
+	renderFlowPreview(preview, state->previewSize, state->previewSize, getDisplayField(state),
+		state->previewTexture, time, state->flowPreviewSettings, &state->jobSystem);
+
+	uploadImage(ctx, state->previewImage, preview.width, preview.height, preview.pixels.data());
+}
+
+static void updateDensity(State* state, GfxContext* ctx)
+{
+	DensityGrid& grid = state->densityGrid;
+	const ParticleDomain domain = getParticleDomain(state->view);
+	const Particles& particles = state->particles[state->particlesFront];
+
+	splatDensity(grid, particles.pos, particles.count, domain.min, domain.max, state->densityDecay, &state->jobSystem,
+		&state->frameArena);
+	colorizeDensity(grid, &state->jobSystem);
+
+	uploadImage(ctx, state->densityImage, grid.width, grid.height, grid.pixels.data());
+}
+
+static void updateDerivedOverlay(State* state, GfxContext* ctx)
+{
+	const FieldQuantity quantity = FieldQuantity(state->derivedOverlay - 1);
+	FieldDerivedMaps& dm = state->derivedMaps;
+
+	updateDerivedMaps(dm, getDisplayField(state), &state->jobSystem, &state->frameArena);
+
+	// Power of two range, so the colors only shift when the extremes change noticeably
+	const float maxValue = getDerivedMapMax(dm, quantity);
+	const float range = maxValue > 0.0f ? exp2f(ceilf(log2f(maxValue))) : 1.0f;
+
+	const bool imageChanged = updateDerivedImage(dm, quantity, range, &state->jobSystem, &state->frameArena);
+	if (imageChanged || state->derivedImageQuantity != u32(quantity))
+	{
+		uploadImage(ctx, state->derivedImage, dm.width, dm.height, dm.maps[u32(quantity)].pixels.data());
+		state->derivedImageQuantity = u32(quantity);
+	}
 }
 
 static void draw(State* state)
@@ -325,6 +793,11 @@ static void draw(State* state)
 	GfxContext* ctx = Platform_GetGfxContext();
 	PrimitiveBatch* prim = state->primitiveBatch;
 
+	// Images are uploaded before the pass begins, texture updates are copies that can't be recorded inside of it
+	if (state->showPreview) updateFlowPreview(state, ctx);
+	if (state->showDensity) updateDensity(state, ctx);
+	if (state->derivedOverlay) updateDerivedOverlay(state, ctx);
+
 	GfxPassDesc passDesc;
 	passDesc.flags = GfxPassFlags::ClearAll;
 	passDesc.clearColors[0] = ColorRGBA8::Black();
@@ -332,24 +805,58 @@ static void draw(State* state)
 	
 	prim->begin2D(state->visualDimensions);
 
+	if (state->showPreview)
+	{
+		Gfx_SetBlendState(ctx, state->blendLerp);
+		drawFieldImage(prim, state->previewImage.texture, state->view, Vec2(0.0f), Vec2(1.0f));
+	}
+
+	if (state->showDensity)
+	{
+		const ParticleDomain domain = getParticleDomain(state->view);
+		Gfx_SetBlendState(ctx, state->blendLerp);
+		drawFieldImage(prim, state->densityImage.texture, state->view, domain.min, domain.max);
+	}
+
+	if (state->derivedOverlay)
+	{
+		Gfx_SetBlendState(ctx, state->blendLerp);
+		drawFieldImage(prim, state->derivedImage.texture, state->view, Vec2(0.0f), Vec2(1.0f));
+	}
+
 	if (state->showParticles) 
 	{
 		Gfx_SetBlendState(ctx, state->blendAdd);
-		drawParticles(prim, state->particles, state->visualDimensions);
+		drawParticles(prim, state->particles[state->particlesFront], state->view, state->frameArena, &state->jobSystem);
 		prim->flush();
 	}
 
 	if (state->showField) 
 	{
 		Gfx_SetBlendState(ctx, state->blendLerp);
-		drawField(prim, state->vectorField, state->visualDimensions);
+		updateFieldMipChain(state->displayFieldMips, getDisplayField(state), &state->jobSystem, &state->frameArena);
+		drawField(prim, state->displayFieldMips, getDisplayField(state), state->view, state->displayFieldStats, &state->jobSystem);
 		prim->flush();
 	}
 
-	if (state->showBrush)
+	Gfx_SetBlendState(ctx, state->blendLerp);
+	drawObstacles(prim, state->layers.obstacles, state->view, state->frameArena);
+	prim->flush();
+
+	if (state->recordingSpline)
 	{
 		Gfx_SetBlendState(ctx, state->blendLerp);
-		drawBrush(prim, state->brushPos * state->visualDimensions, state->brushRadius * state->visualDimensions.x);
+		drawSplinePoints(prim, state->pendingSpline, state->view);
+		prim->flush();
+	}
+
+	const Vec2 brushScreenPos = fieldToScreen(state->view, state->brushPos);
+	const float brushScreenRadius = state->brushRadius * state->view.scale.x;
+
+	if (state->showBrush && isVisible(state->view, brushScreenPos, brushScreenRadius))
+	{
+		Gfx_SetBlendState(ctx, state->blendLerp);
+		drawBrush(prim, brushScreenPos, brushScreenRadius);
 		prim->flush();
 	}
 
@@ -358,28 +865,246 @@ static void draw(State* state)
 	Gfx_EndPass(ctx);
 }
 
+// Brings the whole composite up to date, for consumers that read all of it
+static void flattenLayers(State* state)
+{
+	resolveLayers(state->layers, &state->jobSystem, &state->frameArena);
+	updateLayerComposite(state->layers, &state->jobSystem, &state->frameArena);
+}
+
+static const char* sequencePath = "flowmap.flowseq";
+
+static void captureSequenceKeyframe(State* state)
+{
+	const float keyframeInterval = 1.0f;
+
+	if (state->playingSequence)
+	{
+		RUSH_LOG_ERROR("Stop sequence playback before capturing keyframes");
+		return;
+	}
+
+	if (state->sequenceKeyframeCount == 0 &&
+		!beginSequence(state->sequenceWriter, sequencePath, state->layers.width, state->layers.height))
+	{
+		RUSH_LOG_ERROR("Failed to create %s", sequencePath);
+		return;
+	}
+
+	flattenLayers(state);
+	addSequenceKeyframe(state->sequenceWriter, state->layers.composite, float(state->sequenceKeyframeCount) * keyframeInterval);
+	state->sequenceKeyframeCount++;
+}
+
+static void toggleSequencePlayback(State* state)
+{
+	if (state->playingSequence)
+	{
+		closeSequence(state->sequencePlayer);
+		state->playingSequence = false;
+		return;
+	}
+
+	if (state->sequenceKeyframeCount)
+	{
+		finishSequence(state->sequenceWriter);
+		state->sequenceKeyframeCount = 0;
+	}
+
+	if (!openSequence(state->sequencePlayer, sequencePath))
+	{
+		RUSH_LOG_ERROR("Failed to open %s", sequencePath);
+		return;
+	}
+
+	const SequenceFileHeader& header = state->sequencePlayer.header;
+	createVectorField(state->playbackField, header.width, header.height);
+	initVectorField(state->playbackField, Vec2(0.0f));
+
+	state->playingSequence = true;
+	state->playbackStartTime = state->timer.microTime();
+}
+
+static void importHeightmap(State* state, FieldLayer& layer)
+{
+	if (!state->heightmapPath)
+	{
+		RUSH_LOG_ERROR("No heightmap to import, set FLOWER_HEIGHTMAP");
+		return;
+	}
+
+	if (state->heightmap.heights.empty() && !loadHeightmap(state->heightmap, state->heightmapPath))
+	{
+		RUSH_LOG_ERROR("Failed to load heightmap %s", state->heightmapPath);
+		return;
+	}
+
+	resolveMultiresField(layer.detail, &state->jobSystem, &state->frameArena);
+	generateHeightmapFlow(layer.field, state->heightmap, state->heightmapFlowSettings, &state->jobSystem);
+}
+
+static bool isKeyPressed(State* state, const KeyboardState& kb, u32 key)
+{
+	RUSH_ASSERT(key < RUSH_COUNTOF(state->keysDown));
+
+	const bool down = kb.isKeyDown(key);
+	const bool pressed = down && !state->keysDown[key];
+	state->keysDown[key] = down;
+
+	return pressed;
+}
+
+static void saveFlowmap(State* state, const char* path)
+{
+	FlowmapExport* job = new FlowmapExport;
+	job->path = path;
+
+	flattenLayers(state);
+
+	const VectorField& composite = state->layers.composite;
+	createVectorField(job->field, composite.width, composite.height);
+	memcpy(job->field.data, composite.data, sizeof(Vec2) * composite.count);
+
+	Job exportJob;
+	exportJob.fn = exportFlowmapJob;
+	exportJob.userData = job;
+	submitBackgroundJob(state->jobSystem, exportJob);
+}
+
+// Mean, jitter (standard deviation) and worst frame time, logged every few hundred frames
+static void updateFrameTimeStats(FrameTimeStats& stats, const Timer& timer)
+{
+	if (!stats.enabled) return;
+
+	const u64 now = timer.microTime();
+	if (stats.lastFrameTime)
+	{
+		const double frameTime = double(now - stats.lastFrameTime) / 1000.0;
+		stats.sum += frameTime;
+		stats.sumSquares += frameTime * frameTime;
+		stats.maximum = max(stats.maximum, frameTime);
+		stats.frameCount++;
+	}
+	stats.lastFrameTime = now;
+
+	const u32 framesPerReport = 600;
+	if (stats.frameCount == framesPerReport)
+	{
+		const double mean = stats.sum / stats.frameCount;
+		const double variance = max(0.0, stats.sumSquares / stats.frameCount - mean * mean);
+		RUSH_LOG("Frame time: mean %.2f ms, jitter %.2f ms, max %.2f ms", mean, sqrt(variance), stats.maximum);
+
+		stats = FrameTimeStats();
+		stats.enabled = true;
+		stats.lastFrameTime = now;
+	}
+}
+
+static void updateLayerKeys(State* state, const KeyboardState& kb)
+{
+	LayerStack& layers = state->layers;
+
+	if (isKeyPressed(state, kb, Key_A))
+	{
+		addLayer(layers);
+		RUSH_LOG("Added layer %u", layers.activeLayer + 1);
+	}
+
+	for (u32 i = 0; i < 9; ++i)
+	{
+		if (isKeyPressed(state, kb, Key(Key_1 + i)) && i < layers.layers.size())
+		{
+			layers.activeLayer = i;
+			RUSH_LOG("Active layer %u", i + 1);
+		}
+	}
+
+	FieldLayer& layer = getActiveLayer(layers);
+
+	const bool cycleBlendMode = isKeyPressed(state, kb, Key_B);
+	const bool lowerOpacity = isKeyPressed(state, kb, Key_Q);
+	const bool raiseOpacity = isKeyPressed(state, kb, Key_W);
+
+	if (cycleBlendMode)
+	{
+		layer.blendMode = LayerBlendMode((u32(layer.blendMode) + 1) % u32(LayerBlendMode::Count));
+	}
+
+	if (lowerOpacity) layer.opacity = max(0.0f, layer.opacity - 0.1f);
+	if (raiseOpacity) layer.opacity = min(1.0f, layer.opacity + 0.1f);
+
+	if (cycleBlendMode || lowerOpacity || raiseOpacity)
+	{
+		static const char* blendModeNames[] = { "add", "replace", "normalize-add" };
+		RUSH_LOG("Layer %u: %s, opacity %.1f", layers.activeLayer + 1, blendModeNames[u32(layer.blendMode)], layer.opacity);
+		invalidateLayerComposite(layers);
+	}
+}
+
+static void updateCamera(State* state, const MouseState& ms, const KeyboardState& kb, int zoomDelta)
+{
+	Camera& camera = state->camera;
+
+	if (isKeyPressed(state, kb, Key_Z))
+	{
+		camera = Camera();
+	}
+
+	if (ms.buttons[2])
+	{
+		camera.center -= (ms.pos - state->mousePosPrev) / state->view.scale;
+	}
+
+	state->mousePosPrev = ms.pos;
+
+	if (zoomDelta)
+	{
+		// Field point under the cursor stays in place
+		const ViewTransform view = makeViewTransform(camera, state->visualDimensions);
+		const Vec2 cursorPos = screenToField(view, ms.pos);
+		camera.zoom = clamp(camera.zoom * powf(1.001f, float(zoomDelta)), 0.5f, 64.0f);
+		camera.center = cursorPos - (ms.pos - state->visualDimensions * 0.5f) / (state->visualDimensions * camera.zoom);
+	}
+
+	state->view = makeViewTransform(camera, state->visualDimensions);
+}
+
 static void update(State* state)
 {
 	Window* window = Platform_GetWindow();
 	const MouseState& ms = window->getMouseState();
+	const KeyboardState& kb = window->getKeyboardState();
 
-	state->visualDimensions = window->getSizeFloat();
+	updateFrameTimeStats(state->frameTimeStats, state->timer);
 
-	state->brushPosPrev = state->brushPos;
-	state->brushPos = ms.pos / state->visualDimensions;
+	if (isKeyPressed(state, kb, Key_P)) state->showParticles = !state->showParticles;
+	if (isKeyPressed(state, kb, Key_F)) state->showField = !state->showField;
+	if (isKeyPressed(state, kb, Key_L)) state->fluidMode = !state->fluidMode;
+	if (isKeyPressed(state, kb, Key_T)) state->showPreview = !state->showPreview;
+	if (isKeyPressed(state, kb, Key_D)) state->showDensity = !state->showDensity;
+	if (isKeyPressed(state, kb, Key_M)) state->derivedOverlay = (state->derivedOverlay + 1) % (u32(FieldQuantity::Count) + 1);
+
+	state->visualDimensions = window->getSizeFloat();
 
 	state->mouseWheelPrev = state->mouseWheel;
 	state->mouseWheel = ms.wheelV;
 
 	const int mouseWheelDelta = state->mouseWheel - state->mouseWheelPrev;
+	const bool zooming = mouseWheelDelta != 0 && kb.isKeyDown(Key_LeftControl);
+
+	updateCamera(state, ms, kb, zooming ? mouseWheelDelta : 0);
+
+	state->brushPosPrev = state->brushPos;
+	state->brushPos = screenToField(state->view, ms.pos);
 
 	const bool mouseMoved = state->brushPos != state->brushPosPrev || mouseWheelDelta != 0;
 
-	float brushRadiusDelta = 0.0001f * float(mouseWheelDelta);
-	if (mouseWheelDelta != 0)
+	// Radius is in field units, so it is scaled down with zoom to keep a constant on-screen step
+	float brushRadiusDelta = 0.0001f * float(mouseWheelDelta) / state->camera.zoom;
+	if (mouseWheelDelta != 0 && !zooming)
 	{
 		state->brushRadius += brushRadiusDelta;
-		state->brushRadius = clamp(state->brushRadius, 0.01f, 0.5f);
+		state->brushRadius = clamp(state->brushRadius, 0.001f, 0.5f);
 	}
 
 	if (mouseMoved || ms.buttons[0] || ms.buttons[1])
@@ -390,18 +1115,147 @@ static void update(State* state)
 	const u64 timeSinceLastMouseMove = state->timer.microTime() - state->lastMouseActivityTime;
 	state->showBrush = timeSinceLastMouseMove < 1000000;
 
-	if (ms.buttons[0] && mouseMoved)
+	// Field edits must not race with the simulation reading the field, so the previous frame's simulation
+	// is retired first. Its result becomes the drawn state, keeping particle latency at one frame.
+	if (state->particleSimulation.inFlight)
+	{
+		finishUpdateParticles(state->particleSimulation, &state->jobSystem);
+		state->particlesFront ^= 1;
+	}
+
+	if (isKeyPressed(state, kb, Key_S)) saveFlowmap(state, "flowmap.tga");
+	if (isKeyPressed(state, kb, Key_K)) captureSequenceKeyframe(state);
+	if (isKeyPressed(state, kb, Key_O)) toggleSequencePlayback(state);
+
+	if (state->playingSequence)
+	{
+		// Keeps showing the previous frame until the streamer catches up with the playhead
+		const float playbackTime = float(state->timer.microTime() - state->playbackStartTime) * 1e-6f;
+		const SequencePlaybackStatus status =
+			updateSequencePlayback(state->sequencePlayer, playbackTime, state->playbackField, &state->jobSystem);
+
+		// Back to editing, O retries playback from the start
+		if (status == SequencePlaybackStatus::Failed)
+		{
+			RUSH_LOG_ERROR("Stopped playback of %s, the sequence is damaged", sequencePath);
+			closeSequence(state->sequencePlayer);
+			state->playingSequence = false;
+		}
+	}
+
+	updateLayerKeys(state, kb);
+
+	FieldLayer& activeLayer = getActiveLayer(state->layers);
+	VectorField& activeField = activeLayer.field;
+
+	if (isKeyPressed(state, kb, Key_N))
+	{
+		resolveMultiresField(activeLayer.detail, &state->jobSystem, &state->frameArena);
+		generateCurlNoise(activeField, state->curlNoiseSettings, &state->jobSystem);
+		state->curlNoiseSettings.seed++;
+	}
+
+	if (isKeyPressed(state, kb, Key_I))
+	{
+		importHeightmap(state, activeLayer);
+	}
+
+	// U turns the active layer clockwise, Y mirrors it left to right
+	const bool rotateLayer = isKeyPressed(state, kb, Key_U);
+	const bool mirrorLayer = isKeyPressed(state, kb, Key_Y);
+	if (rotateLayer || mirrorLayer)
+	{
+		// Layers share their dimensions and obstacle mask, so quarter turns are limited to square layers
+		resolveMultiresField(activeLayer.detail, &state->jobSystem, &state->frameArena);
+		if (!transformField(activeField, rotateLayer ? FieldTransform::Rotate90 : FieldTransform::FlipX, &state->jobSystem))
+		{
+			RUSH_LOG_ERROR("Only square layers can be rotated by a quarter turn");
+		}
+	}
+
+	if (isKeyPressed(state, kb, Key_R))
 	{
-		comb(state->vectorField, state->brushPosPrev, state->brushPos, state->brushRadius);
+		resolveMultiresField(activeLayer.detail, &state->jobSystem, &state->frameArena);
+		applyObstacleFlow(activeField, state->obstacleDistance, state->obstacleFlowSettings, &state->jobSystem);
+	}
+
+	const bool mouseLeftPressed = ms.buttons[0] && !state->mouseLeftPrev;
+	state->mouseLeftPrev = ms.buttons[0];
+
+	if (isKeyPressed(state, kb, Key_V))
+	{
+		if (state->recordingSpline && state->pendingSpline.points.size() >= 2)
+		{
+			state->pendingSpline.width = state->brushRadius;
+			resolveMultiresField(activeLayer.detail, &state->jobSystem, &state->frameArena);
+			applySplineFlow(activeField, &state->pendingSpline, 1, &state->jobSystem, &state->frameArena);
+		}
+		state->pendingSpline.points.clear();
+		state->recordingSpline = !state->recordingSpline;
+	}
+
+	const u32 maxStrokeCount = 1;
+	BrushStroke* strokes = allocateFrame<BrushStroke>(state->frameArena, maxStrokeCount);
+	u32 strokeCount = 0;
+
+	// Shift paints obstacles instead of flow, right mouse button erases them
+	const bool paintingObstacles = kb.isKeyDown(Key_LeftShift);
+
+	if (state->recordingSpline)
+	{
+		if (mouseLeftPressed) state->pendingSpline.points.push_back(state->brushPos);
+	}
+	else if (paintingObstacles && (ms.buttons[0] || ms.buttons[1]))
+	{
+		paintObstacles(state->layers.obstacles, state->brushPos, state->brushRadius, ms.buttons[0]);
+	}
+	else if (ms.buttons[0] && mouseMoved)
+	{
+		strokes[strokeCount++] = { BrushTool::Comb, state->brushPosPrev, state->brushPos, state->brushRadius };
 	}
 	else if (ms.buttons[1])
 	{
-		dampen(state->vectorField, state->brushPos, state->brushRadius);
+		strokes[strokeCount++] = { BrushTool::Dampen, state->brushPos, state->brushPos, state->brushRadius };
 	}
 
-	updateParticles(state->particles, state->vectorField, state->rng);
+	applyMultiresStrokes(activeLayer.detail, strokes, strokeCount, &state->jobSystem, &state->frameArena);
+
+	if (state->fluidMode)
+	{
+		resolveMultiresField(activeLayer.detail, &state->jobSystem, &state->frameArena);
+		stepFluid(state->fluidSolver, activeField, state->fluidSettings, &state->jobSystem);
+	}
+
+	// Detail under coarse edits is only synthesized where it can be seen
+	resolveLayers(state->layers, getVisibleFieldRect(state->view, state->layers.width, state->layers.height), &state->jobSystem,
+		&state->frameArena);
+	updateLayerComposite(state->layers, &state->jobSystem, &state->frameArena);
+
+	const FieldStats& stats = state->displayFieldStats;
+	updateFieldStats(state->displayFieldStats, getDisplayField(state), &state->jobSystem, &state->frameArena);
+
+	if (isKeyPressed(state, kb, Key_H))
+	{
+		RUSH_LOG("Field: mean (%.3f, %.3f), mean magnitude %.3f, 95%% magnitude %.3f, max magnitude %.3f, divergence energy %.3f",
+			stats.meanVector.x, stats.meanVector.y, stats.meanMagnitude, getMagnitudePercentile(stats, 0.95f),
+			stats.maxMagnitude, stats.divergenceEnergy);
+	}
+
+	// Simulation of the next frame runs on the workers while this frame's vertices are generated and submitted
+	const u32 particlesBack = state->particlesFront ^ 1;
+	beginUpdateParticles(state->particleSimulation,
+		state->particles[state->particlesFront], state->particles[particlesBack],
+		getDisplayField(state), &state->layers.obstacles, getParticleDomain(state->view), state->rng, &state->jobSystem);
 
 	draw(state);
+
+	resetFrameArena(state->frameArena);
+}
+
+static u64 getEnvironmentValue(const char* name, u64 defaultValue)
+{
+	const char* value = getenv(name);
+	return value ? strtoull(value, nullptr, 0) : defaultValue;
 }
 
 int main()
@@ -410,6 +1264,27 @@ int main()
 
 	State* state = new State;
 
+	// Thread budget, so Flower can share a workstation with other heavy applications.
+	// Affinity masks accept hex values, e.g. FLOWER_WORKER_AFFINITY=0xFF0
+	JobSystemDesc& jobs = state->jobSystemDesc;
+	jobs.workerCount            = u32(getEnvironmentValue("FLOWER_WORKERS", 0));
+	jobs.backgroundWorkerCount  = u32(getEnvironmentValue("FLOWER_BACKGROUND_WORKERS", 1));
+	jobs.mainThreadAffinityMask = getEnvironmentValue("FLOWER_MAIN_AFFINITY", 0);
+	jobs.workerAffinityMask     = getEnvironmentValue("FLOWER_WORKER_AFFINITY", 0);
+	jobs.backgroundAffinityMask = getEnvironmentValue("FLOWER_BACKGROUND_AFFINITY", 0);
+	jobs.isolateMainThread      = getEnvironmentValue("FLOWER_ISOLATE_MAIN", 0) != 0;
+	jobs.pinWorkers             = getEnvironmentValue("FLOWER_PIN_WORKERS", 0) != 0;
+
+	state->frameTimeStats.enabled = getEnvironmentValue("FLOWER_FRAME_STATS", 0) != 0;
+
+	// Flowmap preview, e.g. FLOWER_PREVIEW_TEXTURE=water.tga FLOWER_PREVIEW_SIZE=1024
+	state->previewTexturePath = getenv("FLOWER_PREVIEW_TEXTURE");
+	state->previewSize = clamp(u32(getEnvironmentValue("FLOWER_PREVIEW_SIZE", 1024)), 64u, 4096u);
+
+	// Terrain heightmap for flow import, e.g. FLOWER_HEIGHTMAP=terrain.pgm FLOWER_HEIGHTMAP_SMOOTHING=4
+	state->heightmapPath = getenv("FLOWER_HEIGHTMAP");
+	state->heightmapFlowSettings.smoothRadius = u32(getEnvironmentValue("FLOWER_HEIGHTMAP_SMOOTHING", 0));
+
 	cfg.onStartup  = (PlatformCallback_Startup)startup;
 	cfg.onShutdown = (PlatformCallback_Shutdown)shutdown;
 	cfg.onUpdate   = (PlatformCallback_Update)update;
@@ -0,0 +1,174 @@
+#include "FlowerMerge.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+#include <string.h>
+
+static constexpr u32 tilesPerJob = 16;
+
+static inline u64 getCellBits(const Vec2& v)
+{
+	u64 bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits;
+}
+
+static inline u64 rotateLeft(u64 x, u32 r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Four independent lanes keep the multiplier busy, memory bandwidth is the limit
+static u64 hashTile(const VectorField& vf, const FieldRect& rect)
+{
+	static_assert(sizeof(Vec2) == sizeof(u64), "Cells are hashed as 64 bit words");
+
+	const u64 k = 0x9e3779b97f4a7c15ull;
+	u64 lanes[4] = { 0x243f6a8885a308d3ull, 0x13198a2e03707344ull, 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull };
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		const Vec2* row = vf.data + y * vf.width;
+		u32 x = rect.x0;
+		for (; x + 4 <= rect.x1; x += 4)
+		{
+			for (u32 i = 0; i < 4; ++i)
+			{
+				lanes[i] = rotateLeft((lanes[i] ^ getCellBits(row[x + i])) * k, 29);
+			}
+		}
+		for (; x < rect.x1; ++x)
+		{
+			lanes[0] = rotateLeft((lanes[0] ^ getCellBits(row[x])) * k, 29);
+		}
+	}
+
+	u64 h = lanes[0] ^ rotateLeft(lanes[1], 16) ^ rotateLeft(lanes[2], 32) ^ rotateLeft(lanes[3], 48);
+
+	// Murmur3 finalizer
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+void updateTileHashes(FieldTileHashes& th, const VectorField& vf, JobSystem* jobs)
+{
+	const u32 tileCount = vf.tileCountX * vf.tileCountY;
+
+	if (th.source.field != &vf || th.hashes.size() != tileCount)
+	{
+		resetFieldTileCache(th.source, vf);
+		th.hashes.assign(tileCount, 0);
+	}
+
+	std::vector<u32> dirtyTiles(tileCount);
+	const u32 dirtyCount = collectDirtyTiles(th.source, vf, 0, dirtyTiles.data());
+
+	parallelFor(jobs, dirtyCount, tilesPerJob, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			th.hashes[dirtyTiles[i]] = hashTile(vf, getTileRect(vf, dirtyTiles[i]));
+		}
+	});
+}
+
+enum class TileMergeResult : u8
+{
+	Unchanged,
+	Changed,
+	Conflict,
+};
+
+static TileMergeResult mergeTile(VectorField& ours, const VectorField& base, const VectorField& theirs, const FieldRect& rect)
+{
+	bool changed = false;
+	bool conflict = false;
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		const u32 rowOffset = y * ours.width;
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			const u64 o = getCellBits(ours.data[rowOffset + x]);
+			const u64 b = getCellBits(base.data[rowOffset + x]);
+			const u64 t = getCellBits(theirs.data[rowOffset + x]);
+
+			if (t == b || t == o) continue;
+
+			if (o == b)
+			{
+				ours.data[rowOffset + x] = theirs.data[rowOffset + x];
+				changed = true;
+			}
+			else
+			{
+				conflict = true;
+			}
+		}
+	}
+
+	if (conflict) return TileMergeResult::Conflict;
+	return changed ? TileMergeResult::Changed : TileMergeResult::Unchanged;
+}
+
+bool mergeFields(VectorField& ours, FieldTileHashes& oursHashes,
+	const VectorField& base, FieldTileHashes& baseHashes,
+	const VectorField& theirs, FieldTileHashes& theirsHashes,
+	std::vector<u32>& conflictTiles, JobSystem* jobs)
+{
+	RUSH_ASSERT(ours.width == base.width && ours.height == base.height);
+	RUSH_ASSERT(ours.width == theirs.width && ours.height == theirs.height);
+
+	conflictTiles.clear();
+
+	updateTileHashes(oursHashes, ours, jobs);
+	updateTileHashes(baseHashes, base, jobs);
+	updateTileHashes(theirsHashes, theirs, jobs);
+
+	const u32 tileCount = ours.tileCountX * ours.tileCountY;
+	std::vector<TileMergeResult> results(tileCount, TileMergeResult::Unchanged);
+
+	parallelFor(jobs, tileCount, tilesPerJob, [&](u32 tileBegin, u32 tileEnd)
+	{
+		for (u32 tile = tileBegin; tile < tileEnd; ++tile)
+		{
+			const u64 o = oursHashes.hashes[tile];
+			const u64 b = baseHashes.hashes[tile];
+			const u64 t = theirsHashes.hashes[tile];
+
+			// Nothing to take from theirs
+			if (t == b || t == o) continue;
+
+			const FieldRect rect = getTileRect(ours, tile);
+
+			if (o == b)
+			{
+				for (u32 y = rect.y0; y < rect.y1; ++y)
+				{
+					memcpy(ours.data + rect.x0 + y * ours.width, theirs.data + rect.x0 + y * theirs.width, sizeof(Vec2) * (rect.x1 - rect.x0));
+				}
+				results[tile] = TileMergeResult::Changed;
+			}
+			else
+			{
+				results[tile] = mergeTile(ours, base, theirs, rect);
+			}
+		}
+	});
+
+	for (u32 tile = 0; tile < tileCount; ++tile)
+	{
+		if (results[tile] == TileMergeResult::Unchanged) continue;
+
+		// Conflicting tiles may still have taken the cells that did not conflict
+		markFieldDirty(ours, getTileRect(ours, tile));
+
+		if (results[tile] == TileMergeResult::Conflict) conflictTiles.push_back(tile);
+	}
+
+	return conflictTiles.empty();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "FlowerField.h"
+
+#include <vector>
+
+// 64 bit content hash of every field tile, over the bit patterns of the cells.
+// Only tiles changed since the previous update are hashed again.
+struct FieldTileHashes
+{
+	FieldTileCache source;
+	std::vector<u64> hashes;
+};
+
+void updateTileHashes(FieldTileHashes& th, const VectorField& vf, JobSystem* jobs = nullptr);
+
+// Three-way merge: the changes theirs made to base are applied to ours.
+// Tiles are compared by hash first, cells are only compared in tiles that both sides changed.
+// Cells that both sides changed differently keep ours and their tiles are returned in conflictTiles.
+// All fields must have the same dimensions, equal hashes are trusted to mean equal tiles.
+// Returns true when there were no conflicts.
+bool mergeFields(VectorField& ours, FieldTileHashes& oursHashes,
+	const VectorField& base, FieldTileHashes& baseHashes,
+	const VectorField& theirs, FieldTileHashes& theirsHashes,
+	std::vector<u32>& conflictTiles, JobSystem* jobs = nullptr);
@@ -0,0 +1,371 @@
+#include "FlowerMultires.h"
+#include "FlowerArena.h"
+#include "FlowerJobs.h"
+
+static VectorField& getLevelValues(MultiresField& mf, u32 level)
+{
+	return level ? mf.levels[level]->values : *mf.finest;
+}
+
+static FieldRect getParentRect(const FieldRect& rect, const VectorField& parent)
+{
+	// Bilinear upsample reads the parent cells around each child cell center
+	FieldRect result;
+	result.x0 = rect.x0 ? (rect.x0 - 1) / 2 : 0;
+	result.y0 = rect.y0 ? (rect.y0 - 1) / 2 : 0;
+	result.x1 = min(rect.x1 / 2 + 1, parent.width);
+	result.y1 = min(rect.y1 / 2 + 1, parent.height);
+	return result;
+}
+
+static FieldRect getChildRect(const FieldRect& rect, const VectorField& child)
+{
+	FieldRect result;
+	result.x0 = rect.x0 ? rect.x0 * 2 - 1 : 0;
+	result.y0 = rect.y0 ? rect.y0 * 2 - 1 : 0;
+	result.x1 = min(rect.x1 * 2 + 1, child.width);
+	result.y1 = min(rect.y1 * 2 + 1, child.height);
+	return result;
+}
+
+static FieldRect getTileRange(const VectorField& vf, const FieldRect& rect)
+{
+	FieldRect tiles;
+	tiles.x0 = rect.x0 / VectorField::tileSize;
+	tiles.y0 = rect.y0 / VectorField::tileSize;
+	tiles.x1 = divUp(min(rect.x1, vf.width), VectorField::tileSize);
+	tiles.y1 = divUp(min(rect.y1, vf.height), VectorField::tileSize);
+	return tiles;
+}
+
+static Vec2 upsample(const VectorField& parent, u32 x, u32 y)
+{
+	const float px = max(0.0f, float(x) * 0.5f - 0.25f);
+	const float py = max(0.0f, float(y) * 0.5f - 0.25f);
+
+	const u32 x0 = min(u32(px), parent.width - 1);
+	const u32 y0 = min(u32(py), parent.height - 1);
+	const u32 x1 = min(x0 + 1, parent.width - 1);
+	const u32 y1 = min(y0 + 1, parent.height - 1);
+
+	const float wx = px - float(x0);
+	const float wy = py - float(y0);
+
+	const Vec2 top = lerp(parent.data[x0 + y0 * parent.width], parent.data[x1 + y0 * parent.width], wx);
+	const Vec2 bottom = lerp(parent.data[x0 + y1 * parent.width], parent.data[x1 + y1 * parent.width], wx);
+
+	return lerp(top, bottom, wy);
+}
+
+static void updateResidual(VectorField& residual, const VectorField& values, const VectorField& parent, const FieldRect& rect)
+{
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			residual.data[x + y * residual.width] = values.data[x + y * values.width] - upsample(parent, x, y);
+		}
+	}
+}
+
+static void synthesize(VectorField& values, VectorField& residual, const VectorField& parent, const FieldRect& rect)
+{
+	// Blocked cells keep their value, and cells limited to unit length (like comb results) get the rest.
+	// In both cases the residual absorbs the difference to the parent instead.
+	const ObstacleMask* mask = values.obstacles;
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			Vec2& v = values.data[x + y * values.width];
+			Vec2& r = residual.data[x + y * residual.width];
+			const Vec2 base = upsample(parent, x, y);
+
+			if (mask && isBlocked(*mask, x, y))
+			{
+				r = v - base;
+				continue;
+			}
+
+			const Vec2 result = base + r;
+			const float maxLength = max(1.0f, v.length());
+			const float length = result.length();
+			if (length > maxLength)
+			{
+				v = result * (maxLength / length);
+				r = v - base;
+			}
+			else
+			{
+				v = result;
+			}
+		}
+	}
+}
+
+static constexpr u32 tilesPerJob = 4;
+
+static void resolveLevel(MultiresField& mf, u32 level, const FieldRect& rect, JobSystem* jobs, FrameArena* arena)
+{
+	if (level + 1 >= mf.levels.size() || rect.empty()) return;
+
+	MultiresLevel& l = *mf.levels[level];
+	VectorField& values = getLevelValues(mf, level);
+
+	const FieldRect tiles = getTileRange(values, rect);
+
+	FrameArray<u32> staleTiles(arena, (tiles.x1 - tiles.x0) * (tiles.y1 - tiles.y0));
+	u32 staleCount = 0;
+	FieldRect parentRect = { ~0u, ~0u, 0, 0 };
+
+	for (u32 ty = tiles.y0; ty < tiles.y1; ++ty)
+	{
+		for (u32 tx = tiles.x0; tx < tiles.x1; ++tx)
+		{
+			const u32 tileIndex = tx + ty * values.tileCountX;
+			if (!l.staleTiles[tileIndex]) continue;
+
+			staleTiles[staleCount++] = tileIndex;
+
+			const FieldRect tileParentRect = getParentRect(getTileRect(values, tileIndex), getLevelValues(mf, level + 1));
+			parentRect.x0 = min(parentRect.x0, tileParentRect.x0);
+			parentRect.y0 = min(parentRect.y0, tileParentRect.y0);
+			parentRect.x1 = max(parentRect.x1, tileParentRect.x1);
+			parentRect.y1 = max(parentRect.y1, tileParentRect.y1);
+		}
+	}
+
+	if (!staleCount) return;
+
+	resolveLevel(mf, level + 1, parentRect, jobs, arena);
+
+	const VectorField& parent = getLevelValues(mf, level + 1);
+
+	parallelFor(jobs, staleCount, tilesPerJob, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			synthesize(values, l.residual, parent, getTileRect(values, staleTiles[i]));
+		}
+	});
+
+	for (u32 i = 0; i < staleCount; ++i)
+	{
+		l.staleTiles[staleTiles[i]] = 0;
+		markFieldDirty(values, getTileRect(values, staleTiles[i]));
+	}
+
+	// Synthesized finest tiles are consistent with their residual
+	if (level == 0)
+	{
+		for (u32 i = 0; i < staleCount; ++i)
+		{
+			mf.finestSource.revisions[staleTiles[i]] = values.tileRevisions[staleTiles[i]];
+		}
+	}
+}
+
+// Absorbs direct writes to the finest level into its residual
+static void syncFinestLevel(MultiresField& mf, JobSystem* jobs, FrameArena* arena)
+{
+	if (mf.levels.size() < 2) return;
+
+	VectorField& vf = *mf.finest;
+
+	FrameArray<u32> changedTiles(arena, u32(vf.tileRevisions.size()));
+	const u32 changedCount = collectDirtyTiles(mf.finestSource, vf, 0, changedTiles.data);
+
+	if (!changedCount) return;
+
+	MultiresLevel& l = *mf.levels[0];
+	const VectorField& parent = getLevelValues(mf, 1);
+
+	for (u32 i = 0; i < changedCount; ++i)
+	{
+		RUSH_ASSERT(!l.staleTiles[changedTiles[i]]);
+		resolveLevel(mf, 1, getParentRect(getTileRect(vf, changedTiles[i]), parent), jobs, arena);
+	}
+
+	parallelFor(jobs, changedCount, tilesPerJob, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			updateResidual(l.residual, vf, parent, getTileRect(vf, changedTiles[i]));
+		}
+	});
+}
+
+// Rebuilds the level masks when the finest level's mask was replaced or painted
+static void syncLevelObstacles(MultiresField& mf)
+{
+	const ObstacleMask* obstacles = mf.finest->obstacles;
+	if (mf.obstacles == obstacles && (!obstacles || mf.obstacleRevision == obstacles->revision)) return;
+
+	mf.obstacles = obstacles;
+	mf.obstacleRevision = obstacles ? obstacles->revision : 0;
+
+	for (u32 level = 1; level < u32(mf.levels.size()); ++level)
+	{
+		MultiresLevel& l = *mf.levels[level];
+		if (obstacles)
+		{
+			const ObstacleMask& finer = level == 1 ? *obstacles : mf.levels[level - 1]->obstacles;
+			downsampleObstacleMask(l.obstacles, finer);
+			l.values.obstacles = &l.obstacles;
+		}
+		else
+		{
+			l.values.obstacles = nullptr;
+		}
+	}
+}
+
+void createMultiresField(MultiresField& mf, VectorField& vf, JobSystem* jobs)
+{
+	mf.finest = &vf;
+	mf.finestSource.field = &vf;
+	mf.finestSource.revisions = vf.tileRevisions;
+	mf.levels.clear();
+	mf.obstacles = nullptr;
+
+	// Coarsest level is the first one that fits in a single tile
+	u32 width = vf.width;
+	u32 height = vf.height;
+	for (;;)
+	{
+		std::unique_ptr<MultiresLevel> level(new MultiresLevel);
+		if (!mf.levels.empty())
+		{
+			createVectorField(level->values, width, height);
+		}
+		level->staleTiles.assign(divUp(width, VectorField::tileSize) * divUp(height, VectorField::tileSize), 0);
+		mf.levels.push_back(std::move(level));
+
+		if (width <= VectorField::tileSize && height <= VectorField::tileSize) break;
+
+		width = divUp(width, 2u);
+		height = divUp(height, 2u);
+	}
+
+	// Box filtered values for every level, then residuals against the upsampled parents
+	for (u32 level = 1; level < u32(mf.levels.size()); ++level)
+	{
+		VectorField& dst = getLevelValues(mf, level);
+		const VectorField& src = getLevelValues(mf, level - 1);
+
+		parallelFor(jobs, dst.height, VectorField::tileSize, [&](u32 rowBegin, u32 rowEnd)
+		{
+			for (u32 y = rowBegin; y < rowEnd; ++y)
+			{
+				const Vec2* row0 = src.data + min(y * 2 + 0, src.height - 1) * src.width;
+				const Vec2* row1 = src.data + min(y * 2 + 1, src.height - 1) * src.width;
+				for (u32 x = 0; x < dst.width; ++x)
+				{
+					const u32 x0 = min(x * 2 + 0, src.width - 1);
+					const u32 x1 = min(x * 2 + 1, src.width - 1);
+					dst.data[x + y * dst.width] = (row0[x0] + row0[x1] + row1[x0] + row1[x1]) * 0.25f;
+				}
+			}
+		});
+	}
+
+	for (u32 level = 0; level + 1 < u32(mf.levels.size()); ++level)
+	{
+		const VectorField& values = getLevelValues(mf, level);
+		const VectorField& parent = getLevelValues(mf, level + 1);
+		VectorField& residual = mf.levels[level]->residual;
+
+		createVectorField(residual, values.width, values.height);
+
+		parallelFor(jobs, values.height, VectorField::tileSize, [&](u32 rowBegin, u32 rowEnd)
+		{
+			FieldRect rows = { 0, rowBegin, values.width, rowEnd };
+			updateResidual(residual, values, parent, rows);
+		});
+	}
+
+	syncLevelObstacles(mf);
+}
+
+u32 selectMultiresLevel(const MultiresField& mf, float brushRadius)
+{
+	const u32 levelCount = u32(mf.levels.size());
+
+	u32 level = 0;
+	while (level + 1 < levelCount && brushRadius * float(mf.finest->width >> (level + 1)) >= MultiresField::minBrushCells)
+	{
+		++level;
+	}
+
+	return level;
+}
+
+static void markFinerLevelsStale(MultiresField& mf, u32 level, FieldRect rect)
+{
+	while (level-- > 0)
+	{
+		const VectorField& values = getLevelValues(mf, level);
+		rect = getChildRect(rect, values);
+
+		MultiresLevel& l = *mf.levels[level];
+		const FieldRect tiles = getTileRange(values, rect);
+		for (u32 ty = tiles.y0; ty < tiles.y1; ++ty)
+		{
+			for (u32 tx = tiles.x0; tx < tiles.x1; ++tx)
+			{
+				l.staleTiles[tx + ty * values.tileCountX] = 1;
+			}
+		}
+	}
+}
+
+void applyMultiresStrokes(MultiresField& mf, const BrushStroke* strokes, u32 strokeCount, JobSystem* jobs, FrameArena* arena)
+{
+	syncFinestLevel(mf, jobs, arena);
+	syncLevelObstacles(mf);
+
+	for (u32 i = 0; i < strokeCount; ++i)
+	{
+		const BrushStroke& s = strokes[i];
+		const u32 level = selectMultiresLevel(mf, s.radius);
+
+		VectorField& values = getLevelValues(mf, level);
+		const FieldRect rect = getBrushRect(values, s.cur, s.radius);
+		if (rect.empty()) continue;
+
+		resolveLevel(mf, level, rect, jobs, arena);
+		applyStrokes(values, &s, 1, jobs, arena);
+
+		// Finest level edits are picked up as direct writes by the next sync
+		if (level == 0) continue;
+
+		if (level + 1 < mf.levels.size())
+		{
+			const VectorField& parent = getLevelValues(mf, level + 1);
+			resolveLevel(mf, level + 1, getParentRect(rect, parent), jobs, arena);
+
+			VectorField& residual = mf.levels[level]->residual;
+			parallelFor(jobs, rect.y1 - rect.y0, VectorField::tileSize, [&](u32 rowBegin, u32 rowEnd)
+			{
+				FieldRect rows = { rect.x0, rect.y0 + rowBegin, rect.x1, rect.y0 + rowEnd };
+				updateResidual(residual, values, parent, rows);
+			});
+		}
+
+		markFinerLevelsStale(mf, level, rect);
+	}
+}
+
+void resolveMultiresField(MultiresField& mf, const FieldRect& rect, JobSystem* jobs, FrameArena* arena)
+{
+	syncFinestLevel(mf, jobs, arena);
+	syncLevelObstacles(mf);
+	resolveLevel(mf, 0, rect, jobs, arena);
+}
+
+void resolveMultiresField(MultiresField& mf, JobSystem* jobs, FrameArena* arena)
+{
+	FieldRect rect = { 0, 0, mf.finest->width, mf.finest->height };
+	resolveMultiresField(mf, rect, jobs, arena);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FlowerField.h"
+
+#include <memory>
+#include <vector>
+
+// Sculpt-style multi-resolution editing of a field.
+//
+// The field is represented as a pyramid where every level is the bilinear upsample of the next coarser
+// level plus a residual that holds the detail of that level. Brushes are applied at the coarsest level that
+// still resolves them, so a stroke costs about the same at any radius. Finer levels under a coarse edit are
+// only marked stale and re-synthesized from the residuals when that region is resolved for sampling.
+//
+// Level 0 is the caller's field. It may be written directly (e.g. by filters or simulation) after the
+// written region has been resolved, such writes are absorbed into the level 0 residual.
+//
+// Every coarser level gets a downsampled copy of the field's obstacle mask, where a cell is blocked when it covers
+// any blocked cell, so brushes respect obstacles at the level they are applied at. Synthesis leaves blocked cells
+// untouched and, like the comb brush, doesn't grow vectors beyond unit length (or their previous length if longer).
+
+struct MultiresLevel
+{
+	VectorField values; // unused at level 0, which lives in the caller's field
+	VectorField residual; // unused at the coarsest level
+	ObstacleMask obstacles; // unused at level 0
+	std::vector<u8> staleTiles;
+};
+
+struct MultiresField
+{
+	// Brushes are applied at the coarsest level where their radius still covers this many cells
+	static constexpr float minBrushCells = 32.0f;
+
+	VectorField* finest = nullptr;
+	FieldTileCache finestSource; // tiles of the finest level absorbed into its residual
+	std::vector<std::unique_ptr<MultiresLevel>> levels;
+
+	// Finest obstacle mask the level masks were built from
+	const ObstacleMask* obstacles = nullptr;
+	u32 obstacleRevision = 0;
+};
+
+// Builds the pyramid from the current contents of the field, which must outlive the multires field
+void createMultiresField(MultiresField& mf, VectorField& vf, JobSystem* jobs = nullptr);
+
+u32 selectMultiresLevel(const MultiresField& mf, float brushRadius);
+
+void applyMultiresStrokes(MultiresField& mf, const BrushStroke* strokes, u32 strokeCount, JobSystem* jobs = nullptr,
+	FrameArena* arena = nullptr);
+
+// Brings cells of the finest level in rect up to date
+void resolveMultiresField(MultiresField& mf, const FieldRect& rect, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+void resolveMultiresField(MultiresField& mf, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
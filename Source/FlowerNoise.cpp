@@ -0,0 +1,114 @@
+#include "FlowerNoise.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+static constexpr u32 rowsPerJob = 8;
+
+// Integer hash of a lattice point. Arithmetic only, so the noise loops need no permutation table lookups.
+static inline u32 hashLattice(s32 x, s32 y, u32 seed)
+{
+	u32 h = seed;
+	h ^= u32(x) * 0x8da6b343u;
+	h ^= u32(y) * 0xd8163841u;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return h;
+}
+
+static inline void latticeGradient(u32 h, float& gx, float& gy)
+{
+	gx = float(s32(h & 0xFFFF) - 32768) * (1.0f / 32768.0f);
+	gy = float(s32(h >> 16) - 32768) * (1.0f / 32768.0f);
+}
+
+// Derivative of 2D gradient noise with quintic interpolation
+static inline void gradientNoiseDerivative(float x, float y, u32 seed, float& outDx, float& outDy)
+{
+	// Truncation with a correction for negative values, cheaper than floorf and vectorizes without SSE4.1
+	const s32 ix = s32(x) - (x < float(s32(x)) ? 1 : 0);
+	const s32 iy = s32(y) - (y < float(s32(y)) ? 1 : 0);
+	const float fx = x - float(ix);
+	const float fy = y - float(iy);
+
+	const float ux = fx * fx * fx * (fx * (fx * 6.0f - 15.0f) + 10.0f);
+	const float uy = fy * fy * fy * (fy * (fy * 6.0f - 15.0f) + 10.0f);
+	const float dux = 30.0f * fx * fx * (fx * (fx - 2.0f) + 1.0f);
+	const float duy = 30.0f * fy * fy * (fy * (fy - 2.0f) + 1.0f);
+
+	float gax, gay, gbx, gby, gcx, gcy, gdx, gdy;
+	latticeGradient(hashLattice(ix,     iy,     seed), gax, gay);
+	latticeGradient(hashLattice(ix + 1, iy,     seed), gbx, gby);
+	latticeGradient(hashLattice(ix,     iy + 1, seed), gcx, gcy);
+	latticeGradient(hashLattice(ix + 1, iy + 1, seed), gdx, gdy);
+
+	const float va = gax * fx + gay * fy;
+	const float vb = gbx * (fx - 1.0f) + gby * fy;
+	const float vc = gcx * fx + gcy * (fy - 1.0f);
+	const float vd = gdx * (fx - 1.0f) + gdy * (fy - 1.0f);
+
+	const float k = va - vb - vc + vd;
+
+	outDx = gax + ux * (gbx - gax) + uy * (gcx - gax) + ux * uy * (gax - gbx - gcx + gdx) + dux * (uy * k + (vb - va));
+	outDy = gay + ux * (gby - gay) + uy * (gcy - gay) + ux * uy * (gay - gby - gcy + gdy) + duy * (ux * k + (vc - va));
+}
+
+void generateCurlNoise(VectorField& vf, const CurlNoiseSettings& settings, JobSystem* jobs)
+{
+	const u32 octaves = max(1u, settings.octaves);
+
+	float amplitudeSum = 0.0f;
+	float octaveAmplitude = 1.0f;
+	for (u32 i = 0; i < octaves; ++i)
+	{
+		amplitudeSum += octaveAmplitude;
+		octaveAmplitude *= settings.persistence;
+	}
+
+	// Noise gradients rarely exceed this length, which maps the result to roughly [0, amplitude]
+	const float typicalMaxDerivative = 1.25f;
+	const float outputScale = settings.amplitude / (amplitudeSum * typicalMaxDerivative);
+	const float cellToNoise = settings.frequency / float(max(vf.width, vf.height));
+
+	parallelFor(jobs, vf.height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		for (u32 y = rowBegin; y < rowEnd; ++y)
+		{
+			Vec2* row = vf.data + y * vf.width;
+
+			forEachUnblockedSpan(vf, y, 0, vf.width, [&](u32 x0, u32 x1, u32 blockedBits)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					if (isBlockedBit(blockedBits, x)) continue;
+
+					Vec2 v = Vec2(0.0f);
+					float frequency = cellToNoise;
+					float amplitude = outputScale;
+
+					for (u32 octave = 0; octave < octaves; ++octave)
+					{
+						const u32 octaveSeed = settings.seed + octave * 0x68e31da4u;
+
+						float dx, dy;
+						gradientNoiseDerivative((float(x) + 0.5f) * frequency, (float(y) + 0.5f) * frequency, octaveSeed,
+							dx, dy);
+
+						// 2D curl of a scalar potential
+						v.x += dy * amplitude;
+						v.y -= dx * amplitude;
+
+						frequency *= settings.lacunarity;
+						amplitude *= settings.persistence;
+					}
+
+					row[x] = v;
+				}
+			});
+		}
+	});
+
+	markFieldDirty(vf);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+struct JobSystem;
+struct VectorField;
+
+struct CurlNoiseSettings
+{
+	u32 seed = 1;
+
+	// Noise periods across the longer side of the field at the first octave
+	float frequency = 4.0f;
+
+	u32 octaves = 4;
+	float lacunarity = 2.0f;
+	float persistence = 0.5f;
+
+	// Approximate maximum vector length of the result
+	float amplitude = 0.5f;
+};
+
+// Fills the field with the curl of multi-octave gradient noise, which is divergence-free.
+// Derivatives are analytic, so no finite differencing error is introduced.
+// Cells blocked by the obstacle mask keep their values, so the result is only divergence-free away from obstacles.
+void generateCurlNoise(VectorField& vf, const CurlNoiseSettings& settings, JobSystem* jobs = nullptr);
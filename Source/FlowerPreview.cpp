@@ -0,0 +1,191 @@
+#include "FlowerPreview.h"
+#include "FlowerField.h"
+#include "FlowerImage.h"
+#include "FlowerJobs.h"
+
+#include <string.h>
+
+bool loadPreviewTexture(PreviewTexture& texture, const char* path)
+{
+	u32 width, height;
+	std::vector<u8> rgba;
+	if (!loadTga(path, width, height, rgba)) return false;
+
+	texture.width = width;
+	texture.height = height;
+	texture.texels.resize(size_t(width) * height);
+	memcpy(texture.texels.data(), rgba.data(), rgba.size());
+
+	return true;
+}
+
+void createCheckerboardTexture(PreviewTexture& texture, u32 size, u32 checkerSize)
+{
+	texture.width = size;
+	texture.height = size;
+	texture.texels.resize(size_t(size) * size);
+
+	for (u32 y = 0; y < size; ++y)
+	{
+		for (u32 x = 0; x < size; ++x)
+		{
+			const bool odd = ((x / checkerSize) ^ (y / checkerSize)) & 1;
+			texture.texels[x + y * size] = odd ? 0xFF404040 : 0xFFB0B0B0;
+		}
+	}
+}
+
+// Lerps all four 8 bit channels at once, two per 16 bit lane. Weight is in [0, 256].
+static inline u32 lerpTexel(u32 a, u32 b, u32 weight)
+{
+	const u32 rb = ((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight) >> 8;
+	const u32 ga = (((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight) >> 8;
+	return (rb & 0x00FF00FF) | ((ga & 0x00FF00FF) << 8);
+}
+
+static inline int floorToInt(float v)
+{
+	int i = int(v);
+	return i - (v < float(i));
+}
+
+static inline bool isPowerOfTwo(u32 v)
+{
+	return v && !(v & (v - 1));
+}
+
+static inline u32 wrapCoord(int i, u32 size)
+{
+	int r = i % int(size);
+	return u32(r < 0 ? r + int(size) : r);
+}
+
+// Power of two textures wrap with a mask instead of an integer division per tap
+template <bool powerOfTwo>
+static inline u32 wrapTexel(int i, u32 size)
+{
+	return powerOfTwo ? u32(i) & (size - 1) : wrapCoord(i, size);
+}
+
+template <bool powerOfTwo>
+static inline u32 sampleBilinear(const PreviewTexture& texture, float u, float v)
+{
+	const float tx = u * float(texture.width) - 0.5f;
+	const float ty = v * float(texture.height) - 0.5f;
+
+	const int ix = floorToInt(tx);
+	const int iy = floorToInt(ty);
+
+	const u32 wx = u32((tx - float(ix)) * 256.0f);
+	const u32 wy = u32((ty - float(iy)) * 256.0f);
+
+	const u32 x0 = wrapTexel<powerOfTwo>(ix, texture.width);
+	const u32 x1 = wrapTexel<powerOfTwo>(ix + 1, texture.width);
+	const u32* row0 = &texture.texels[wrapTexel<powerOfTwo>(iy, texture.height) * texture.width];
+	const u32* row1 = &texture.texels[wrapTexel<powerOfTwo>(iy + 1, texture.height) * texture.width];
+
+	return lerpTexel(lerpTexel(row0[x0], row0[x1], wx), lerpTexel(row1[x0], row1[x1], wx), wy);
+}
+
+template <bool powerOfTwo>
+static void renderPreviewRows(FlowPreview& preview, const VectorField& vf, const PreviewTexture& texture,
+	Vec2 phaseOffsets, u32 blendWeight, float tiling, u32 rowBegin, u32 rowEnd)
+{
+	static constexpr u32 spanSize = 64;
+
+	float flowX[spanSize];
+	float flowY[spanSize];
+
+	const u32 width = preview.width;
+	const float uScale = tiling / float(preview.width);
+	const float vScale = tiling / float(preview.height);
+
+	for (u32 y = rowBegin; y < rowEnd; ++y)
+	{
+		const float fy = (float(y) + 0.5f) * float(vf.height) / float(preview.height) - 0.5f;
+		const int iy = floorToInt(fy);
+		const float wy = fy - float(iy);
+		const Vec2* fieldRow0 = vf.data + wrapCoord(iy, vf.height) * vf.width;
+		const Vec2* fieldRow1 = vf.data + wrapCoord(iy + 1, vf.height) * vf.width;
+
+		u32* out = &preview.pixels[size_t(y) * width];
+		const float v = (float(y) + 0.5f) * vScale;
+
+		for (u32 spanBegin = 0; spanBegin < width; spanBegin += spanSize)
+		{
+			const u32 spanEnd = min(spanBegin + spanSize, width);
+
+			// Gather the field first, so the texture pass below only does texture fetches
+			for (u32 x = spanBegin; x < spanEnd; ++x)
+			{
+				const u32 x0 = preview.columnX0[x];
+				const u32 x1 = preview.columnX1[x];
+				const float wx = preview.columnWeight[x];
+				const Vec2 top = lerp(fieldRow0[x0], fieldRow0[x1], wx);
+				const Vec2 bottom = lerp(fieldRow1[x0], fieldRow1[x1], wx);
+				flowX[x - spanBegin] = top.x + (bottom.x - top.x) * wy;
+				flowY[x - spanBegin] = top.y + (bottom.y - top.y) * wy;
+			}
+
+			for (u32 x = spanBegin; x < spanEnd; ++x)
+			{
+				const float u = (float(x) + 0.5f) * uScale;
+				const float fx = flowX[x - spanBegin];
+				const float fy = flowY[x - spanBegin];
+
+				const u32 sample0 = sampleBilinear<powerOfTwo>(texture, u - fx * phaseOffsets.x, v - fy * phaseOffsets.x);
+				const u32 sample1 = sampleBilinear<powerOfTwo>(texture, u - fx * phaseOffsets.y, v - fy * phaseOffsets.y);
+
+				out[x] = lerpTexel(sample0, sample1, blendWeight) | 0xFF000000;
+			}
+		}
+	}
+}
+
+void renderFlowPreview(FlowPreview& preview, u32 width, u32 height,
+	const VectorField& vf, const PreviewTexture& texture, float time,
+	const FlowPreviewSettings& settings, JobSystem* jobs)
+{
+	preview.width = width;
+	preview.height = height;
+	preview.pixels.resize(size_t(width) * height);
+
+	preview.columnX0.resize(width);
+	preview.columnX1.resize(width);
+	preview.columnWeight.resize(width);
+
+	// Field is sampled bilinearly between cell centers, wrapping like sample()
+	for (u32 x = 0; x < width; ++x)
+	{
+		const float fx = (float(x) + 0.5f) * float(vf.width) / float(width) - 0.5f;
+		const int ix = floorToInt(fx);
+		preview.columnX0[x] = wrapCoord(ix, vf.width);
+		preview.columnX1[x] = wrapCoord(ix + 1, vf.width);
+		preview.columnWeight[x] = fx - float(ix);
+	}
+
+	const float cycle = time / settings.cycleDuration;
+	const float phase0 = cycle - floorf(cycle);
+	const float phase1 = phase0 < 0.5f ? phase0 + 0.5f : phase0 - 0.5f;
+
+	// Weight of the second phase, which is fully visible while the first one resets
+	const u32 blendWeight = u32(fabsf(1.0f - 2.0f * phase0) * 256.0f);
+
+	const Vec2 phaseOffsets = Vec2(phase0, phase1) * settings.strength * settings.tiling;
+
+	const bool powerOfTwo = isPowerOfTwo(texture.width) && isPowerOfTwo(texture.height);
+
+	static constexpr u32 rowsPerJob = 16;
+
+	parallelFor(jobs, height, rowsPerJob, [&](u32 rowBegin, u32 rowEnd)
+	{
+		if (powerOfTwo)
+		{
+			renderPreviewRows<true>(preview, vf, texture, phaseOffsets, blendWeight, settings.tiling, rowBegin, rowEnd);
+		}
+		else
+		{
+			renderPreviewRows<false>(preview, vf, texture, phaseOffsets, blendWeight, settings.tiling, rowBegin, rowEnd);
+		}
+	});
+}
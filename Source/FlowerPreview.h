@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+struct JobSystem;
+struct VectorField;
+
+// Texture that is distorted by the preview, RGBA8 texels packed into u32 with red in the low byte
+struct PreviewTexture
+{
+	u32 width = 0;
+	u32 height = 0;
+	std::vector<u32> texels;
+};
+
+bool loadPreviewTexture(PreviewTexture& texture, const char* path);
+void createCheckerboardTexture(PreviewTexture& texture, u32 size, u32 checkerSize);
+
+struct FlowPreviewSettings
+{
+	// Seconds for one phase to go from undistorted to fully distorted
+	float cycleDuration = 1.0f;
+
+	// Texture coordinate offset reached at the end of a phase for a unit length vector
+	float strength = 0.05f;
+
+	// Texture repeats across the field
+	float tiling = 4.0f;
+};
+
+// CPU reference of the usual two-phase flowmap shader: the texture is sampled twice with offsets along
+// the flow that grow over half-cycle-shifted phases, and the samples are blended so each phase resets
+// while it is invisible.
+struct FlowPreview
+{
+	u32 width = 0;
+	u32 height = 0;
+	std::vector<u32> pixels;
+
+	// Field lookup per output column, shared by all rows
+	std::vector<u32> columnX0;
+	std::vector<u32> columnX1;
+	std::vector<float> columnWeight;
+};
+
+void renderFlowPreview(FlowPreview& preview, u32 width, u32 height,
+	const VectorField& vf, const PreviewTexture& texture, float time,
+	const FlowPreviewSettings& settings, JobSystem* jobs = nullptr);
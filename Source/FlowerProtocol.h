@@ -0,0 +1,98 @@
+#pragma once
+
+#include "FlowerApi.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+// Wire format of the local baking service (FlowerServer).
+// Every request is a ServerRequestHeader followed by payloadSize bytes,
+// every reply is a ServerResponseHeader followed by payloadSize bytes.
+// All values are little-endian, matching the host since the service is local only.
+
+static constexpr uint32_t ServerProtocolMagic      = 0x52574c46; // "FLWR"
+static constexpr uint32_t ServerMaxPayloadSize     = 256u << 20;
+static constexpr uint32_t ServerMaxFieldDimension  = 16384;
+static constexpr const char* ServerDefaultSocketPath = "/tmp/flower.sock";
+
+enum class ServerCommand : uint32_t
+{
+	CreateDocument,  // in: ServerCreateDocument, out: uint32_t document id
+	DestroyDocument, // in: nothing
+	Fill,            // in: float x, float y
+	ApplyStrokes,    // in: FlowerStroke[payloadSize / sizeof(FlowerStroke)]
+	ApplyFilter,     // in: ServerApplyFilter
+	Export,          // in: nothing, out: ServerExportHeader followed by RGBA8 texels
+};
+
+enum class ServerStatus : uint32_t
+{
+	Ok,
+	InvalidRequest,
+	UnknownDocument,
+	OutOfMemory,
+};
+
+struct ServerRequestHeader
+{
+	uint32_t magic;
+	uint32_t command; // ServerCommand
+	uint32_t document;
+	uint32_t payloadSize;
+};
+
+struct ServerResponseHeader
+{
+	uint32_t magic;
+	uint32_t status; // ServerStatus
+	uint32_t payloadSize;
+	uint32_t reserved;
+};
+
+struct ServerCreateDocument
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+struct ServerApplyFilter
+{
+	uint32_t filter; // FlowerFilter
+	uint32_t param;
+};
+
+struct ServerExportHeader
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+// Blocking socket IO shared by the service and its clients. Both fail once the connection is closed.
+
+inline bool readAll(int fd, void* data, size_t size)
+{
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(data);
+	while (size)
+	{
+		ssize_t n = read(fd, ptr, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		ptr += n;
+		size -= size_t(n);
+	}
+	return true;
+}
+
+inline bool writeAll(int fd, const void* data, size_t size)
+{
+	const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+	while (size)
+	{
+		ssize_t n = write(fd, ptr, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		ptr += n;
+		size -= size_t(n);
+	}
+	return true;
+}
@@ -0,0 +1,555 @@
+#include "FlowerSequence.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+#include <Rush/UtilLog.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static constexpr u32 maxSequenceDimension = 16384;
+
+static u64 fileTell(FILE* f)
+{
+#if defined(_WIN32)
+	return u64(_ftelli64(f));
+#else
+	return u64(ftello(f));
+#endif
+}
+
+static bool fileSeek(FILE* f, u64 offset)
+{
+#if defined(_WIN32)
+	return _fseeki64(f, s64(offset), SEEK_SET) == 0;
+#else
+	return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+// v is in units of the keyframe range, the clamp only absorbs rounding and non-finite values
+static s16 quantize(float v)
+{
+	return s16(clamp(v, -1.0f, 1.0f) * 32767.0f + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static float dequantize(s16 v, float range)
+{
+	return float(v) * (range / 32767.0f);
+}
+
+static u64 getFileSize(FILE* f)
+{
+#if defined(_WIN32)
+	if (_fseeki64(f, 0, SEEK_END) != 0) return 0;
+#else
+	if (fseeko(f, 0, SEEK_END) != 0) return 0;
+#endif
+	return fileTell(f);
+}
+
+struct TileRange
+{
+	u32 x0, y0, x1, y1;
+};
+
+static TileRange getTileRange(u32 width, u32 height, u32 tileSize, u32 tileIndex)
+{
+	const u32 tileCountX = divUp(width, tileSize);
+
+	TileRange range;
+	range.x0 = (tileIndex % tileCountX) * tileSize;
+	range.y0 = (tileIndex / tileCountX) * tileSize;
+	range.x1 = min(range.x0 + tileSize, width);
+	range.y1 = min(range.y0 + tileSize, height);
+	return range;
+}
+
+static u32 getTileCount(u32 width, u32 height, u32 tileSize)
+{
+	return divUp(width, tileSize) * divUp(height, tileSize);
+}
+
+bool beginSequence(SequenceWriter& writer, const char* path, u32 width, u32 height)
+{
+	if (width == 0 || height == 0 || width > maxSequenceDimension || height > maxSequenceDimension) return false;
+
+	writer.path = path;
+	writer.tempPath = writer.path + ".tmp";
+	writer.file = fopen(writer.tempPath.c_str(), "wb");
+	if (!writer.file) return false;
+
+	writer.width = width;
+	writer.height = height;
+	writer.previous.assign(size_t(width) * height * 2, 0);
+	writer.keyframes.clear();
+
+	// Placeholder, the final header is written by finishSequence
+	SequenceFileHeader header = {};
+	return fwrite(&header, sizeof(header), 1, writer.file) == 1;
+}
+
+bool addSequenceKeyframe(SequenceWriter& writer, const VectorField& vf, float time)
+{
+	if (!writer.file || vf.width != writer.width || vf.height != writer.height) return false;
+	if (!writer.keyframes.empty() && !(time > writer.keyframes.back().time)) return false;
+
+	const u32 tileSize = SequenceTileSize;
+	const u32 tileCount = getTileCount(vf.width, vf.height, tileSize);
+	const bool intra = writer.keyframes.size() % writer.intraInterval == 0;
+
+	float maxComponent = 0.0f;
+	for (u32 i = 0; i < vf.count; ++i)
+	{
+		maxComponent = max(maxComponent, max(fabsf(vf.data[i].x), fabsf(vf.data[i].y)));
+	}
+
+	// Powers of two keep the range, and with it the quantized values, stable while the largest component drifts
+	float range = 1.0f;
+	if (maxComponent > 1.0f && maxComponent <= FLT_MAX / 2)
+	{
+		int exponent = 0;
+		frexpf(maxComponent, &exponent);
+		range = ldexpf(1.0f, exponent);
+	}
+
+	const float scale = 1.0f / range;
+
+	std::vector<s16> current(size_t(vf.count) * 2);
+	for (u32 i = 0; i < vf.count; ++i)
+	{
+		current[i * 2 + 0] = quantize(vf.data[i].x * scale);
+		current[i * 2 + 1] = quantize(vf.data[i].y * scale);
+	}
+
+	if (intra)
+	{
+		memset(writer.previous.data(), 0, writer.previous.size() * sizeof(s16));
+	}
+
+	std::vector<u8> mask(divUp(tileCount, 8), 0);
+	std::vector<s16> deltas;
+
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		const TileRange range = getTileRange(vf.width, vf.height, tileSize, tileIndex);
+
+		bool changed = false;
+		for (u32 y = range.y0; y < range.y1 && !changed; ++y)
+		{
+			const size_t rowBegin = (size_t(y) * vf.width + range.x0) * 2;
+			const size_t rowSize = (range.x1 - range.x0) * 2 * sizeof(s16);
+			changed = memcmp(&current[rowBegin], &writer.previous[rowBegin], rowSize) != 0;
+		}
+
+		if (!changed) continue;
+
+		mask[tileIndex / 8] |= u8(1 << (tileIndex % 8));
+
+		for (u32 y = range.y0; y < range.y1; ++y)
+		{
+			for (u32 i = (y * vf.width + range.x0) * 2; i < (y * vf.width + range.x1) * 2; ++i)
+			{
+				deltas.push_back(s16(u16(current[i]) - u16(writer.previous[i])));
+			}
+		}
+	}
+
+	SequenceKeyframeEntry entry;
+	entry.time = time;
+	entry.flags = intra ? u32(SequenceKeyframeFlag_Intra) : 0u;
+	entry.offset = fileTell(writer.file);
+	entry.size = mask.size() + deltas.size() * sizeof(s16);
+	entry.range = range;
+	entry.reserved = 0;
+
+	bool ok = fwrite(mask.data(), mask.size(), 1, writer.file) == 1;
+	if (!deltas.empty())
+	{
+		ok = ok && fwrite(deltas.data(), deltas.size() * sizeof(s16), 1, writer.file) == 1;
+	}
+
+	writer.keyframes.push_back(entry);
+	writer.previous.swap(current);
+
+	return ok;
+}
+
+bool finishSequence(SequenceWriter& writer)
+{
+	if (!writer.file) return false;
+
+	SequenceFileHeader header;
+	header.magic = SequenceFileMagic;
+	header.version = SequenceFileVersion;
+	header.width = writer.width;
+	header.height = writer.height;
+	header.tileSize = SequenceTileSize;
+	header.keyframeCount = u32(writer.keyframes.size());
+	header.tableOffset = fileTell(writer.file);
+
+	bool ok = writer.keyframes.empty() ||
+		fwrite(writer.keyframes.data(), sizeof(SequenceKeyframeEntry) * writer.keyframes.size(), 1, writer.file) == 1;
+	ok = ok && fileSeek(writer.file, 0);
+	ok = ok && fwrite(&header, sizeof(header), 1, writer.file) == 1;
+	ok = (fclose(writer.file) == 0) && ok;
+
+#if defined(_WIN32)
+	// rename does not replace existing files on Windows
+	if (ok) remove(writer.path.c_str());
+#endif
+	ok = ok && rename(writer.tempPath.c_str(), writer.path.c_str()) == 0;
+	if (!ok) remove(writer.tempPath.c_str());
+
+	writer.file = nullptr;
+	writer.previous.clear();
+	writer.keyframes.clear();
+
+	return ok;
+}
+
+// Applies one keyframe blob on top of the previous decoded state
+static bool applyKeyframe(const SequencePlayer& player, const SequenceKeyframeEntry& entry, const std::vector<u8>& blob, std::vector<s16>& state)
+{
+	const SequenceFileHeader& header = player.header;
+	const u32 tileCount = getTileCount(header.width, header.height, header.tileSize);
+	const size_t maskSize = divUp(tileCount, 8);
+
+	if (blob.size() < maskSize) return false;
+
+	if (entry.flags & SequenceKeyframeFlag_Intra)
+	{
+		memset(state.data(), 0, state.size() * sizeof(s16));
+	}
+
+	size_t offset = maskSize;
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		if (!(blob[tileIndex / 8] & (1 << (tileIndex % 8)))) continue;
+
+		const TileRange range = getTileRange(header.width, header.height, header.tileSize, tileIndex);
+		const size_t tileSize = size_t(range.x1 - range.x0) * (range.y1 - range.y0) * 2 * sizeof(s16);
+		if (offset + tileSize > blob.size()) return false;
+
+		const u8* deltas = blob.data() + offset;
+		for (u32 y = range.y0; y < range.y1; ++y)
+		{
+			for (u32 i = (y * header.width + range.x0) * 2; i < (y * header.width + range.x1) * 2; ++i)
+			{
+				s16 delta;
+				memcpy(&delta, deltas, sizeof(delta));
+				deltas += sizeof(delta);
+				state[i] = s16(u16(state[i]) + u16(delta));
+			}
+		}
+
+		offset += tileSize;
+	}
+
+	return true;
+}
+
+// Brings the loader's decoded state to the given keyframe, from the closest intra keyframe when needed
+static bool decodeKeyframe(SequencePlayer& player, u32 keyframe)
+{
+	if (player.decodedKeyframe == keyframe) return true;
+
+	u32 intraKeyframe = keyframe;
+	while (intraKeyframe > 0 && !(player.keyframes[intraKeyframe].flags & SequenceKeyframeFlag_Intra))
+	{
+		--intraKeyframe;
+	}
+
+	u32 first = intraKeyframe;
+	if (player.decodedKeyframe != ~0u && player.decodedKeyframe >= intraKeyframe && player.decodedKeyframe < keyframe)
+	{
+		first = player.decodedKeyframe + 1;
+	}
+
+	for (u32 i = first; i <= keyframe; ++i)
+	{
+		const SequenceKeyframeEntry& entry = player.keyframes[i];
+
+		player.blob.resize(size_t(entry.size));
+		if (!fileSeek(player.file, entry.offset) ||
+			(entry.size && fread(player.blob.data(), size_t(entry.size), 1, player.file) != 1) ||
+			!applyKeyframe(player, entry, player.blob, player.decoded))
+		{
+			player.decodedKeyframe = ~0u;
+			return false;
+		}
+
+		player.decodedKeyframe = i;
+	}
+
+	return true;
+}
+
+static u32 getStreamingWindowSize(const SequencePlayer& player)
+{
+	return min(u32(player.keyframes.size()), SequencePlayer::residentKeyframeCount);
+}
+
+static bool isInStreamingWindow(const SequencePlayer& player, u32 keyframe)
+{
+	const u32 count = u32(player.keyframes.size());
+	const u32 distance = (keyframe + count - player.playheadKeyframe) % count;
+	return distance < getStreamingWindowSize(player);
+}
+
+// Finds the next keyframe ahead of the playhead that is not resident and a slot to decode it into
+static bool findLoadTask(SequencePlayer& player, u32& outKeyframe, u32& outSlot)
+{
+	const u32 count = u32(player.keyframes.size());
+	const u32 windowSize = getStreamingWindowSize(player);
+
+	for (u32 i = 0; i < windowSize; ++i)
+	{
+		const u32 keyframe = (player.playheadKeyframe + i) % count;
+
+		bool resident = false;
+		for (const SequencePlayer::Slot& slot : player.slots)
+		{
+			resident |= slot.keyframe == keyframe && (slot.ready || slot.loading);
+		}
+		if (resident) continue;
+
+		for (u32 slotIndex = 0; slotIndex < SequencePlayer::residentKeyframeCount; ++slotIndex)
+		{
+			const SequencePlayer::Slot& slot = player.slots[slotIndex];
+			const bool evictable = !slot.loading && slot.pinCount == 0 &&
+				(!slot.ready || !isInStreamingWindow(player, slot.keyframe));
+			if (evictable)
+			{
+				outKeyframe = keyframe;
+				outSlot = slotIndex;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	return false;
+}
+
+static void loaderMain(SequencePlayer* player)
+{
+	std::unique_lock<std::mutex> lock(player->lock);
+
+	for (;;)
+	{
+		u32 keyframe = 0;
+		u32 slotIndex = 0;
+		player->loaderCondition.wait(lock, [&] { return player->stopping || findLoadTask(*player, keyframe, slotIndex); });
+
+		if (player->stopping) break;
+
+		SequencePlayer::Slot& slot = player->slots[slotIndex];
+		slot.keyframe = keyframe;
+		slot.ready = false;
+		slot.loading = true;
+
+		lock.unlock();
+
+		const bool decoded = decodeKeyframe(*player, keyframe);
+		if (decoded)
+		{
+			slot.data = player->decoded;
+		}
+
+		lock.lock();
+
+		slot.loading = false;
+		slot.ready = decoded;
+
+		if (!decoded)
+		{
+			RUSH_LOG_ERROR("Failed to decode sequence keyframe %u", keyframe);
+			player->failed = true;
+			break;
+		}
+	}
+}
+
+bool openSequence(SequencePlayer& player, const char* path)
+{
+	closeSequence(player);
+
+	player.file = fopen(path, "rb");
+	if (!player.file) return false;
+
+	const u64 fileSize = getFileSize(player.file);
+
+	SequenceFileHeader& header = player.header;
+	const bool headerValid =
+		fileSeek(player.file, 0) &&
+		fread(&header, sizeof(header), 1, player.file) == 1 &&
+		header.magic == SequenceFileMagic &&
+		header.version == SequenceFileVersion &&
+		header.width && header.width <= maxSequenceDimension &&
+		header.height && header.height <= maxSequenceDimension &&
+		header.tileSize && header.tileSize <= 1024 &&
+		header.keyframeCount != 0 &&
+		header.tableOffset >= sizeof(header) && header.tableOffset <= fileSize &&
+		header.keyframeCount <= (fileSize - header.tableOffset) / sizeof(SequenceKeyframeEntry);
+
+	if (headerValid)
+	{
+		player.keyframes.resize(header.keyframeCount);
+	}
+
+	if (!headerValid || !fileSeek(player.file, header.tableOffset) ||
+		fread(player.keyframes.data(), sizeof(SequenceKeyframeEntry) * header.keyframeCount, 1, player.file) != 1 ||
+		!(player.keyframes[0].flags & SequenceKeyframeFlag_Intra))
+	{
+		closeSequence(player);
+		return false;
+	}
+
+	// Blobs must lie between the header and the table, so decoding never allocates more than the file holds
+	for (u32 i = 0; i < header.keyframeCount; ++i)
+	{
+		const SequenceKeyframeEntry& entry = player.keyframes[i];
+		const bool entryValid =
+			entry.offset >= sizeof(header) && entry.offset <= header.tableOffset &&
+			entry.size <= header.tableOffset - entry.offset &&
+			entry.range >= 1.0f && entry.range <= FLT_MAX &&
+			(i == 0 || entry.time > player.keyframes[i - 1].time);
+		if (!entryValid)
+		{
+			closeSequence(player);
+			return false;
+		}
+	}
+
+	player.decoded.assign(size_t(header.width) * header.height * 2, 0);
+	player.decodedKeyframe = ~0u;
+	player.playheadKeyframe = 0;
+	player.stopping = false;
+	player.failed = false;
+
+	player.loader = std::thread(loaderMain, &player);
+
+	return true;
+}
+
+void closeSequence(SequencePlayer& player)
+{
+	if (player.loader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> guard(player.lock);
+			player.stopping = true;
+		}
+		player.loaderCondition.notify_all();
+		player.loader.join();
+	}
+
+	if (player.file)
+	{
+		fclose(player.file);
+		player.file = nullptr;
+	}
+
+	for (SequencePlayer::Slot& slot : player.slots)
+	{
+		slot = SequencePlayer::Slot();
+	}
+
+	player.keyframes.clear();
+	player.decoded.clear();
+	player.decodedKeyframe = ~0u;
+}
+
+float getSequenceDuration(const SequencePlayer& player)
+{
+	return player.keyframes.empty() ? 0.0f : player.keyframes.back().time - player.keyframes.front().time;
+}
+
+static SequencePlayer::Slot* findReadySlot(SequencePlayer& player, u32 keyframe)
+{
+	for (SequencePlayer::Slot& slot : player.slots)
+	{
+		if (slot.ready && slot.keyframe == keyframe) return &slot;
+	}
+	return nullptr;
+}
+
+SequencePlaybackStatus updateSequencePlayback(SequencePlayer& player, float time, VectorField& vf, JobSystem* jobs)
+{
+	if (player.keyframes.empty()) return SequencePlaybackStatus::Failed;
+	if (vf.width != player.header.width || vf.height != player.header.height) return SequencePlaybackStatus::Failed;
+
+	const u32 count = u32(player.keyframes.size());
+	const float startTime = player.keyframes.front().time;
+	const float duration = getSequenceDuration(player);
+
+	float t = startTime;
+	if (duration > 0.0f)
+	{
+		t += fmodf(max(0.0f, time), duration);
+	}
+
+	// Last keyframe at or before t, keyframe times are increasing
+	u32 a = 0;
+	u32 lo = 0, hi = count;
+	while (lo < hi)
+	{
+		u32 mid = (lo + hi) / 2;
+		if (player.keyframes[mid].time <= t) { a = mid; lo = mid + 1; }
+		else { hi = mid; }
+	}
+
+	const u32 b = min(a + 1, count - 1);
+	const float span = player.keyframes[b].time - player.keyframes[a].time;
+	const float alpha = span > 0.0f ? clamp((t - player.keyframes[a].time) / span, 0.0f, 1.0f) : 0.0f;
+
+	SequencePlayer::Slot* slotA;
+	SequencePlayer::Slot* slotB;
+	{
+		std::lock_guard<std::mutex> guard(player.lock);
+
+		if (player.failed) return SequencePlaybackStatus::Failed;
+
+		if (player.playheadKeyframe != a)
+		{
+			player.playheadKeyframe = a;
+			player.loaderCondition.notify_one();
+		}
+
+		slotA = findReadySlot(player, a);
+		slotB = findReadySlot(player, b);
+		if (!slotA || !slotB) return SequencePlaybackStatus::Pending;
+
+		slotA->pinCount++;
+		slotB->pinCount++;
+	}
+
+	const s16* dataA = slotA->data.data();
+	const s16* dataB = slotB->data.data();
+	const float rangeA = player.keyframes[a].range;
+	const float rangeB = player.keyframes[b].range;
+
+	parallelFor(jobs, vf.count, 64 * 1024, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const Vec2 va(dequantize(dataA[i * 2 + 0], rangeA), dequantize(dataA[i * 2 + 1], rangeA));
+			const Vec2 vb(dequantize(dataB[i * 2 + 0], rangeB), dequantize(dataB[i * 2 + 1], rangeB));
+			vf.data[i] = lerp(va, vb, alpha);
+		}
+	});
+
+	{
+		std::lock_guard<std::mutex> guard(player.lock);
+		slotA->pinCount--;
+		slotB->pinCount--;
+	}
+	player.loaderCondition.notify_one();
+
+	markFieldDirty(vf);
+
+	return SequencePlaybackStatus::Updated;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+struct JobSystem;
+struct VectorField;
+
+// Animated flow stored as a sequence of VectorField keyframes on disk.
+//
+// Vector components are quantized to 16 bit over [-range, range]. The range is chosen per keyframe as a power of two
+// covering its largest component, at least 1 since composites of added layers can exceed unit length.
+// Each keyframe stores only the tiles that differ from the previous keyframe, as 16 bit deltas of the quantized values,
+// which stay lossless when the range changes. Every few keyframes an intra keyframe is stored against a zero field,
+// so playback can seek without decoding the whole sequence.
+//
+// File layout: SequenceFileHeader, keyframe data blobs, SequenceKeyframeEntry table at tableOffset.
+// Each blob is a bitmask of changed tiles followed by the deltas of every changed tile in row-major order.
+
+static constexpr u32 SequenceFileMagic   = 0x51455346; // "FSEQ"
+static constexpr u32 SequenceFileVersion = 2;
+static constexpr u32 SequenceTileSize    = 32;
+
+struct SequenceFileHeader
+{
+	u32 magic;
+	u32 version;
+	u32 width;
+	u32 height;
+	u32 tileSize;
+	u32 keyframeCount;
+	u64 tableOffset;
+};
+
+enum SequenceKeyframeFlags : u32
+{
+	SequenceKeyframeFlag_Intra = 1 << 0,
+};
+
+struct SequenceKeyframeEntry
+{
+	float time;
+	u32 flags;
+	u64 offset;
+	u64 size;
+	float range;
+	u32 reserved;
+};
+
+// Writes to a temporary file next to the path, which replaces the file at the path once the sequence is finished.
+// Players that still have the previous file open keep reading it.
+struct SequenceWriter
+{
+	FILE* file = nullptr;
+	std::string path;
+	std::string tempPath;
+	u32 width = 0;
+	u32 height = 0;
+	u32 intraInterval = 16;
+
+	std::vector<s16> previous;
+	std::vector<SequenceKeyframeEntry> keyframes;
+};
+
+bool beginSequence(SequenceWriter& writer, const char* path, u32 width, u32 height);
+
+// Keyframe times must be increasing. The field must match the sequence dimensions.
+bool addSequenceKeyframe(SequenceWriter& writer, const VectorField& vf, float time);
+
+bool finishSequence(SequenceWriter& writer);
+
+// Streams keyframes from disk on a loader thread, ahead of the playhead.
+// Only residentKeyframeCount decoded keyframes are kept in memory, independent of sequence length.
+struct SequencePlayer
+{
+	static constexpr u32 residentKeyframeCount = 4;
+
+	struct Slot
+	{
+		u32 keyframe = ~0u;
+		bool ready = false;
+		bool loading = false;
+		u32 pinCount = 0;
+		std::vector<s16> data;
+	};
+
+	FILE* file = nullptr;
+	SequenceFileHeader header = {};
+	std::vector<SequenceKeyframeEntry> keyframes;
+
+	std::thread loader;
+	std::mutex lock;
+	std::condition_variable loaderCondition;
+	bool stopping = false;
+	bool failed = false; // set by the loader when a keyframe can't be decoded, it stops streaming
+	u32 playheadKeyframe = 0;
+
+	Slot slots[residentKeyframeCount];
+
+	// Loader state, only touched by the loader thread
+	u32 decodedKeyframe = ~0u;
+	std::vector<s16> decoded;
+	std::vector<u8> blob;
+};
+
+bool openSequence(SequencePlayer& player, const char* path);
+void closeSequence(SequencePlayer& player);
+
+float getSequenceDuration(const SequencePlayer& player);
+
+enum class SequencePlaybackStatus : u32
+{
+	Updated, // the field was written
+	Pending, // keyframes have not been streamed in yet, the field is untouched
+	Failed,  // a keyframe could not be decoded or the field does not match, playback can't continue
+};
+
+// Writes the field interpolated between the keyframes around time (wrapped to the sequence duration).
+SequencePlaybackStatus updateSequencePlayback(SequencePlayer& player, float time, VectorField& vf,
+	JobSystem* jobs = nullptr);
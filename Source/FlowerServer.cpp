@@ -0,0 +1,354 @@
+// Headless baking service.
+// Listens on a unix domain socket and keeps documents resident between requests.
+// Every connection is served by its own thread, while the field work of all documents
+// runs on one shared job system. Requests touching the same document are serialized
+// by a per-document lock. SIGINT or SIGTERM closes all connections and stops the service.
+
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+#include "FlowerProtocol.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct Document
+{
+	std::mutex lock;
+	VectorField field;
+};
+
+struct Connection
+{
+	int fd = -1;
+	std::thread thread;
+	std::atomic<bool> finished = { false };
+};
+
+struct Server
+{
+	JobSystem jobs;
+
+	std::mutex documentsLock;
+	std::unordered_map<u32, std::shared_ptr<Document>> documents;
+	u32 nextDocumentId = 1;
+
+	// Only touched by the accepting thread
+	std::list<std::unique_ptr<Connection>> connections;
+};
+
+static bool reply(int fd, ServerStatus status, const void* payload = nullptr, u32 payloadSize = 0)
+{
+	ServerResponseHeader header = {};
+	header.magic = ServerProtocolMagic;
+	header.status = u32(status);
+	header.payloadSize = payloadSize;
+	return writeAll(fd, &header, sizeof(header)) && writeAll(fd, payload, payloadSize);
+}
+
+static std::shared_ptr<Document> findDocument(Server& server, u32 id)
+{
+	std::lock_guard<std::mutex> guard(server.documentsLock);
+	auto it = server.documents.find(id);
+	return it == server.documents.end() ? nullptr : it->second;
+}
+
+static bool handleRequest(Server& server, int fd, const ServerRequestHeader& header, const std::vector<u8>& payload)
+{
+	const ServerCommand command = ServerCommand(header.command);
+
+	if (command == ServerCommand::CreateDocument)
+	{
+		ServerCreateDocument desc;
+		if (payload.size() != sizeof(desc)) return reply(fd, ServerStatus::InvalidRequest);
+		memcpy(&desc, payload.data(), sizeof(desc));
+
+		if (desc.width == 0 || desc.height == 0 ||
+			desc.width > ServerMaxFieldDimension || desc.height > ServerMaxFieldDimension)
+		{
+			return reply(fd, ServerStatus::InvalidRequest);
+		}
+
+		// Fields of up to 2 GB are accepted, the allocation may fail
+		std::shared_ptr<Document> doc = std::make_shared<Document>();
+		createVectorField(doc->field, desc.width, desc.height);
+		initVectorField(doc->field, Vec2(0.0f));
+
+		u32 id;
+		{
+			std::lock_guard<std::mutex> guard(server.documentsLock);
+			id = server.nextDocumentId++;
+			server.documents[id] = doc;
+		}
+
+		return reply(fd, ServerStatus::Ok, &id, sizeof(id));
+	}
+
+	if (command == ServerCommand::DestroyDocument)
+	{
+		std::lock_guard<std::mutex> guard(server.documentsLock);
+		bool erased = server.documents.erase(header.document) != 0;
+		return reply(fd, erased ? ServerStatus::Ok : ServerStatus::UnknownDocument);
+	}
+
+	std::shared_ptr<Document> doc = findDocument(server, header.document);
+	if (!doc) return reply(fd, ServerStatus::UnknownDocument);
+
+	std::lock_guard<std::mutex> docGuard(doc->lock);
+	VectorField& vf = doc->field;
+
+	switch (command)
+	{
+	case ServerCommand::Fill:
+	{
+		float value[2];
+		if (payload.size() != sizeof(value)) return reply(fd, ServerStatus::InvalidRequest);
+		memcpy(value, payload.data(), sizeof(value));
+		initVectorField(vf, Vec2(value[0], value[1]));
+		return reply(fd, ServerStatus::Ok);
+	}
+	case ServerCommand::ApplyStrokes:
+	{
+		if (payload.size() % sizeof(FlowerStroke) != 0) return reply(fd, ServerStatus::InvalidRequest);
+
+		const u32 strokeCount = u32(payload.size() / sizeof(FlowerStroke));
+		std::vector<BrushStroke> strokes(strokeCount);
+		for (u32 i = 0; i < strokeCount; ++i)
+		{
+			FlowerStroke s;
+			memcpy(&s, payload.data() + i * sizeof(FlowerStroke), sizeof(s));
+
+			strokes[i].tool = BrushTool(s.tool);
+			strokes[i].prev = Vec2(s.prevX, s.prevY);
+			strokes[i].cur = Vec2(s.x, s.y);
+			strokes[i].radius = s.radius;
+
+			if (!isValidBrushStroke(strokes[i])) return reply(fd, ServerStatus::InvalidRequest);
+		}
+
+		applyStrokes(vf, strokes.data(), strokeCount, &server.jobs);
+		return reply(fd, ServerStatus::Ok);
+	}
+	case ServerCommand::ApplyFilter:
+	{
+		ServerApplyFilter desc;
+		if (payload.size() != sizeof(desc)) return reply(fd, ServerStatus::InvalidRequest);
+		memcpy(&desc, payload.data(), sizeof(desc));
+		if (desc.filter > FLOWER_FILTER_NORMALIZE) return reply(fd, ServerStatus::InvalidRequest);
+		applyFilter(vf, FieldFilter(desc.filter), desc.param, &server.jobs);
+		return reply(fd, ServerStatus::Ok);
+	}
+	case ServerCommand::Export:
+	{
+		std::vector<u8> result(sizeof(ServerExportHeader) + size_t(vf.count) * 4);
+
+		ServerExportHeader exportHeader;
+		exportHeader.width = vf.width;
+		exportHeader.height = vf.height;
+		memcpy(result.data(), &exportHeader, sizeof(exportHeader));
+
+		exportFlowmap(vf, result.data() + sizeof(exportHeader), vf.width * 4, &server.jobs);
+		return reply(fd, ServerStatus::Ok, result.data(), u32(result.size()));
+	}
+	default:
+		return reply(fd, ServerStatus::InvalidRequest);
+	}
+}
+
+static void serveConnection(Server& server, Connection& connection)
+{
+	const int fd = connection.fd;
+
+	std::vector<u8> payload;
+	for (;;)
+	{
+		ServerRequestHeader header;
+		if (!readAll(fd, &header, sizeof(header))) break;
+
+		if (header.magic != ServerProtocolMagic || header.payloadSize > ServerMaxPayloadSize)
+		{
+			reply(fd, ServerStatus::InvalidRequest);
+			break;
+		}
+
+		try
+		{
+			payload.resize(header.payloadSize);
+		}
+		catch (const std::bad_alloc&)
+		{
+			// The payload can not be skipped without reading it, so the connection ends here
+			reply(fd, ServerStatus::OutOfMemory);
+			break;
+		}
+
+		if (!readAll(fd, payload.data(), payload.size())) break;
+
+		bool ok;
+		try
+		{
+			ok = handleRequest(server, fd, header, payload);
+		}
+		catch (const std::bad_alloc&)
+		{
+			ok = reply(fd, ServerStatus::OutOfMemory);
+		}
+
+		if (!ok) break;
+	}
+
+	connection.finished = true;
+}
+
+// Joins connection threads that have ended. With force, open connections are shut down first.
+static void reapConnections(Server& server, bool force)
+{
+	for (auto it = server.connections.begin(); it != server.connections.end();)
+	{
+		Connection& connection = **it;
+
+		if (force)
+		{
+			shutdown(connection.fd, SHUT_RDWR);
+		}
+		else if (!connection.finished)
+		{
+			++it;
+			continue;
+		}
+
+		connection.thread.join();
+		close(connection.fd);
+		it = server.connections.erase(it);
+	}
+}
+
+// Written by the signal handler to wake up the accept loop
+static int g_stopPipe[2] = { -1, -1 };
+
+static void onStopSignal(int)
+{
+	const u8 wake = 1;
+	ssize_t unused = write(g_stopPipe[1], &wake, 1);
+	(void)unused;
+}
+
+int main(int argc, char** argv)
+{
+	const char* socketPath = argc > 1 ? argv[1] : ServerDefaultSocketPath;
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+		return 1;
+	}
+	strcpy(addr.sun_path, socketPath);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (pipe(g_stopPipe) != 0)
+	{
+		perror("pipe");
+		return 1;
+	}
+	fcntl(g_stopPipe[1], F_SETFL, O_NONBLOCK);
+
+	struct sigaction stopAction = {};
+	stopAction.sa_handler = onStopSignal;
+	sigemptyset(&stopAction.sa_mask);
+	sigaction(SIGINT, &stopAction, nullptr);
+	sigaction(SIGTERM, &stopAction, nullptr);
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+
+	unlink(socketPath);
+
+	if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd, 64) != 0)
+	{
+		perror("bind");
+		return 1;
+	}
+
+	Server* server = new Server;
+
+	// This thread only accepts connections and never runs jobs, so every hardware thread gets a worker.
+	// Connection threads help with the jobs they wait for.
+	JobSystemDesc jobsDesc;
+	jobsDesc.workerCount = max(1u, std::thread::hardware_concurrency());
+	startJobSystem(server->jobs, jobsDesc);
+
+	printf("Flower server listening on %s with %u job threads\n", socketPath, getJobThreadCount(&server->jobs));
+	fflush(stdout);
+
+	int result = 0;
+
+	for (;;)
+	{
+		pollfd fds[2] = {};
+		fds[0].fd = listenFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = g_stopPipe[0];
+		fds[1].events = POLLIN;
+
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			perror("poll");
+			result = 1;
+			break;
+		}
+
+		if (fds[1].revents) break;
+		if (!(fds[0].revents & POLLIN)) continue;
+
+		int fd = accept(listenFd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			result = 1;
+			break;
+		}
+
+		reapConnections(*server, false);
+
+		std::unique_ptr<Connection> connection(new Connection);
+		connection->fd = fd;
+		connection->thread = std::thread(serveConnection, std::ref(*server), std::ref(*connection));
+		server->connections.push_back(std::move(connection));
+	}
+
+	printf("Flower server stopping\n");
+
+	close(listenFd);
+	unlink(socketPath);
+
+	reapConnections(*server, true);
+	stopJobSystem(server->jobs);
+	delete server;
+
+	return result;
+}
@@ -0,0 +1,334 @@
+#include "FlowerSpline.h"
+#include "FlowerArena.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+#include <float.h>
+
+struct SplineSegment
+{
+	Vec2 a, b;           // end points in field cells
+	Vec2 tangentA;       // curve tangents at the end points, normalized
+	Vec2 tangentB;
+	float width;         // in field cells
+	float strength;
+};
+
+static Vec2 evaluateCatmullRom(const Vec2& p0, const Vec2& p1, const Vec2& p2, const Vec2& p3, float t)
+{
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+	return ((p1 * 2.0f) + (p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+}
+
+static Vec2 evaluateCatmullRomTangent(const Vec2& p0, const Vec2& p1, const Vec2& p2, const Vec2& p3, float t)
+{
+	const float t2 = t * t;
+	return ((p2 - p0) + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * (2.0f * t) + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * (3.0f * t2)) * 0.5f;
+}
+
+struct SplineSpan
+{
+	Vec2 p0, p1, p2, p3;
+	float width;
+	float strength;
+};
+
+// Splits the curve until each segment deviates from it by less than a fraction of a cell.
+// Segments end up as long as the curvature allows, which keeps the number of candidates per cell low.
+static void subdivideSpan(std::vector<SplineSegment>& segments, const SplineSpan& span,
+	float t0, float t1, const Vec2& a, const Vec2& b, u32 depth)
+{
+	static constexpr float tolerance = 0.25f;
+	static constexpr float maxSegmentLength = 256.0f;
+	static constexpr u32 maxDepth = 16;
+	static constexpr float smallNumber = 0.00001f;
+
+	const float tm = 0.5f * (t0 + t1);
+	const Vec2 m = evaluateCatmullRom(span.p0, span.p1, span.p2, span.p3, tm);
+
+	const bool flat = (m - (a + b) * 0.5f).length() < tolerance && (b - a).length() < maxSegmentLength;
+	if (!flat && depth < maxDepth)
+	{
+		subdivideSpan(segments, span, t0, tm, a, m, depth + 1);
+		subdivideSpan(segments, span, tm, t1, m, b, depth + 1);
+		return;
+	}
+
+	if ((b - a).length() < smallNumber) return;
+
+	const Vec2 tangentA = evaluateCatmullRomTangent(span.p0, span.p1, span.p2, span.p3, t0);
+	const Vec2 tangentB = evaluateCatmullRomTangent(span.p0, span.p1, span.p2, span.p3, t1);
+
+	SplineSegment segment;
+	segment.a = a;
+	segment.b = b;
+	segment.tangentA = normalize(tangentA.length() > smallNumber ? tangentA : b - a);
+	segment.tangentB = normalize(tangentB.length() > smallNumber ? tangentB : b - a);
+	segment.width = span.width;
+	segment.strength = span.strength;
+	segments.push_back(segment);
+}
+
+static void tessellateSpline(std::vector<SplineSegment>& segments, const FlowSpline& spline, const Vec2& fieldDimensions)
+{
+	const u32 pointCount = u32(spline.points.size());
+	if (pointCount < 2) return;
+
+	auto point = [&](int i)
+	{
+		return spline.points[clamp(i, 0, int(pointCount) - 1)] * fieldDimensions;
+	};
+
+	for (u32 i = 0; i + 1 < pointCount; ++i)
+	{
+		SplineSpan span;
+		span.p0 = point(int(i) - 1);
+		span.p1 = point(int(i));
+		span.p2 = point(int(i) + 1);
+		span.p3 = point(int(i) + 2);
+		span.width = spline.width * min(fieldDimensions.x, fieldDimensions.y);
+		span.strength = spline.strength;
+
+		// Starting from quarters catches S-shaped spans, whose midpoint may lie on the chord
+		for (u32 j = 0; j < 4; ++j)
+		{
+			const float t0 = float(j) * 0.25f;
+			const float t1 = float(j + 1) * 0.25f;
+			const Vec2 a = evaluateCatmullRom(span.p0, span.p1, span.p2, span.p3, t0);
+			const Vec2 b = evaluateCatmullRom(span.p0, span.p1, span.p2, span.p3, t1);
+			subdivideSpan(segments, span, t0, t1, a, b, 0);
+		}
+	}
+}
+
+// Per segment values for the distance test, computed once and shared by every tile the segment overlaps
+struct SegmentCandidate
+{
+	float ax, ay;
+	float abx, aby;
+	float lengthSq;
+	float invLengthSq;
+	float invWidthSq;
+	float reach;         // width plus a cell of slack, covering rounding in the row runs below
+	float reachLength;   // reach * segment length
+	float reachY0, reachY1;
+};
+
+static void addInterval(float& lo, float& hi, float a, float b)
+{
+	lo = min(lo, min(a, b));
+	hi = max(hi, max(a, b));
+}
+
+// Cells of row py within reach of the segment, as [x0, x1) clipped to [spanX0, spanX1). Points within reach form a capsule,
+// whose slice of a row is a single run: the hull of the slices of the end point disks and of the band between them.
+// Returns false when the run is empty.
+static bool getCandidateRowRun(const SegmentCandidate& c, float py, u32 spanX0, u32 spanX1, u32& x0, u32& x1)
+{
+	if (py < c.reachY0 || py > c.reachY1) return false;
+
+	const float reachSq = c.reach * c.reach;
+	const float dyA = py - c.ay;
+	const float dyB = dyA - c.aby;
+
+	float lo = FLT_MAX;
+	float hi = -FLT_MAX;
+
+	if (dyA * dyA <= reachSq)
+	{
+		const float h = sqrtf(reachSq - dyA * dyA);
+		addInterval(lo, hi, c.ax - h, c.ax + h);
+	}
+
+	if (dyB * dyB <= reachSq)
+	{
+		const float h = sqrtf(reachSq - dyB * dyB);
+		addInterval(lo, hi, c.ax + c.abx - h, c.ax + c.abx + h);
+	}
+
+	// Band of points projecting onto the segment: 0 <= dot(p - a, ab) <= lengthSq and |cross(p - a, ab)| <= reachLength.
+	// Each condition bounds x - ax unless the segment is axis aligned, in which case it holds for the whole row or none of it.
+	float bandLo = -FLT_MAX;
+	float bandHi = FLT_MAX;
+	bool band = true;
+
+	const float projectionOffset = dyA * c.aby;
+	if (c.abx != 0.0f)
+	{
+		const float ua = -projectionOffset / c.abx;
+		const float ub = (c.lengthSq - projectionOffset) / c.abx;
+		bandLo = max(bandLo, min(ua, ub));
+		bandHi = min(bandHi, max(ua, ub));
+	}
+	else
+	{
+		band = projectionOffset >= 0.0f && projectionOffset <= c.lengthSq;
+	}
+
+	const float crossOffset = dyA * c.abx;
+	if (c.aby != 0.0f)
+	{
+		const float ua = (crossOffset - c.reachLength) / c.aby;
+		const float ub = (crossOffset + c.reachLength) / c.aby;
+		bandLo = max(bandLo, min(ua, ub));
+		bandHi = min(bandHi, max(ua, ub));
+	}
+	else
+	{
+		band = band && fabsf(crossOffset) <= c.reachLength;
+	}
+
+	if (band && bandLo <= bandHi)
+	{
+		addInterval(lo, hi, c.ax + bandLo, c.ax + bandHi);
+	}
+
+	if (lo > hi) return false;
+
+	x0 = u32(clamp(lo, float(spanX0), float(spanX1)));
+	x1 = u32(clamp(hi + 1.0f, float(spanX0), float(spanX1)));
+	return x0 < x1;
+}
+
+void applySplineFlow(VectorField& vf, const FlowSpline* splines, u32 splineCount, JobSystem* jobs, FrameArena* arena)
+{
+	const Vec2 fieldDimensions = Vec2(float(vf.width), float(vf.height));
+
+	std::vector<SplineSegment> segments;
+	for (u32 i = 0; i < splineCount; ++i)
+	{
+		tessellateSpline(segments, splines[i], fieldDimensions);
+	}
+
+	if (segments.empty()) return;
+
+	const u32 segmentCount = u32(segments.size());
+
+	// Bin segments into every tile their bounds overlap
+	const u32 tileCount = vf.tileCountX * vf.tileCountY;
+	const float tileSize = float(VectorField::tileSize);
+
+	auto getTileBounds = [&](const SplineSegment& s)
+	{
+		const Vec2 lo = Vec2(min(s.a.x, s.b.x), min(s.a.y, s.b.y)) - Vec2(s.width);
+		const Vec2 hi = Vec2(max(s.a.x, s.b.x), max(s.a.y, s.b.y)) + Vec2(s.width);
+		FieldRect bounds;
+		bounds.x0 = u32(clamp(lo.x / tileSize, 0.0f, float(vf.tileCountX)));
+		bounds.y0 = u32(clamp(lo.y / tileSize, 0.0f, float(vf.tileCountY)));
+		bounds.x1 = u32(clamp(hi.x / tileSize + 1.0f, 0.0f, float(vf.tileCountX)));
+		bounds.y1 = u32(clamp(hi.y / tileSize + 1.0f, 0.0f, float(vf.tileCountY)));
+		return bounds;
+	};
+
+	FrameArray<FieldRect> segmentTileBounds(arena, segmentCount);
+	FrameArray<SegmentCandidate> segmentCandidates(arena, segmentCount);
+	for (u32 segmentIndex = 0; segmentIndex < segmentCount; ++segmentIndex)
+	{
+		const SplineSegment& s = segments[segmentIndex];
+		segmentTileBounds[segmentIndex] = getTileBounds(s);
+
+		const Vec2 ab = s.b - s.a;
+		SegmentCandidate& c = segmentCandidates[segmentIndex];
+		c.ax = s.a.x;
+		c.ay = s.a.y;
+		c.abx = ab.x;
+		c.aby = ab.y;
+		c.lengthSq = dot(ab, ab);
+		c.invLengthSq = 1.0f / c.lengthSq;
+		c.invWidthSq = 1.0f / (s.width * s.width);
+		c.reach = s.width + 1.0f;
+		c.reachLength = c.reach * sqrtf(c.lengthSq);
+		c.reachY0 = min(s.a.y, s.b.y) - c.reach;
+		c.reachY1 = max(s.a.y, s.b.y) + c.reach;
+	}
+
+	FrameArray<u32> tileSegmentOffsets(arena, tileCount + 1);
+	FrameArray<u32> touchedTiles(arena, tileCount);
+	const u32 touchedCount = countTileBins(vf, segmentTileBounds.data, segmentCount, tileSegmentOffsets.data,
+		touchedTiles.data);
+
+	FrameArray<u32> tileSegments(arena, tileSegmentOffsets[tileCount]);
+	fillTileBins(vf, segmentTileBounds.data, segmentCount, tileSegmentOffsets.data, tileSegments.data);
+
+	parallelFor(jobs, touchedCount, 1, [&](u32 begin, u32 end)
+	{
+		// Nearest candidate of every cell in the current row span, relative to its width,
+		// so overlapping splines of different widths blend sensibly
+		float bestDistancesSq[VectorField::tileSize];
+		float bestTs[VectorField::tileSize];
+		u32 bestSegments[VectorField::tileSize];
+
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u32 tileIndex = touchedTiles[i];
+			const FieldRect rect = getTileRect(vf, tileIndex);
+			const u32* candidates = &tileSegments[tileSegmentOffsets[tileIndex]];
+			const u32 candidateCount = tileSegmentOffsets[tileIndex + 1] - tileSegmentOffsets[tileIndex];
+
+			for (u32 y = rect.y0; y < rect.y1; ++y)
+			{
+				forEachUnblockedSpan(vf, y, rect.x0, rect.x1, [&](u32 spanX0, u32 spanX1, u32 blockedBits)
+				{
+					const float py = float(y);
+
+					for (u32 k = 0; k < spanX1 - spanX0; ++k)
+					{
+						bestDistancesSq[k] = 1.0f;
+						bestSegments[k] = ~0u;
+					}
+
+					// Candidates in segment order with a strict comparison, so ties go to the earlier segment.
+					// Each candidate only visits the cells of the row within its reach.
+					for (u32 j = 0; j < candidateCount; ++j)
+					{
+						const SegmentCandidate c = segmentCandidates[candidates[j]];
+
+						u32 x0, x1;
+						if (!getCandidateRowRun(c, py, spanX0, spanX1, x0, x1)) continue;
+
+						const float dy = py - c.ay;
+						for (u32 x = x0; x < x1; ++x)
+						{
+							const float dx = float(x) - c.ax;
+							const float t = min(1.0f, max(0.0f, (dx * c.abx + dy * c.aby) * c.invLengthSq));
+							const float ex = dx - c.abx * t;
+							const float ey = dy - c.aby * t;
+							const float distanceSq = (ex * ex + ey * ey) * c.invWidthSq;
+
+							const u32 k = x - spanX0;
+							if (distanceSq < bestDistancesSq[k])
+							{
+								bestDistancesSq[k] = distanceSq;
+								bestTs[k] = t;
+								bestSegments[k] = candidates[j];
+							}
+						}
+					}
+
+					for (u32 x = spanX0; x < spanX1; ++x)
+					{
+						const u32 k = x - spanX0;
+						if (bestSegments[k] == ~0u || isBlockedBit(blockedBits, x)) continue;
+
+						const SplineSegment& s = segments[bestSegments[k]];
+
+						const float falloff = 1.0f - sqrtf(bestDistancesSq[k]);
+						const float weight = falloff * falloff * (3.0f - 2.0f * falloff);
+
+						Vec2 tangent = lerp(s.tangentA, s.tangentB, bestTs[k]);
+						tangent = tangent.length() > 0.001f ? normalize(tangent) : normalize(s.b - s.a);
+
+						Vec2& v = vf.data[x + y * vf.width];
+						v = lerp(v, tangent * s.strength, weight);
+					}
+				});
+			}
+		}
+	});
+
+	for (u32 i = 0; i < touchedCount; ++i)
+	{
+		markFieldDirty(vf, getTileRect(vf, touchedTiles[i]));
+	}
+}
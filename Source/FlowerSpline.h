@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <vector>
+
+struct FrameArena;
+struct JobSystem;
+struct VectorField;
+
+// Catmull-Rom spline through control points given in normalized field coordinates
+struct FlowSpline
+{
+	std::vector<Vec2> points;
+
+	// Distance from the curve where the falloff reaches zero, relative to the shorter side of the field,
+	// so the falloff stays round and a spline covers the same share of a field and of its transpose
+	float width = 0.05f;
+
+	// Length of the written flow vectors on the curve
+	float strength = 1.0f;
+};
+
+// Blends flow along the curve tangents into the field, with a smooth falloff across the spline width.
+// Curves are split into segments that are binned per field tile, and within a tile each segment only visits
+// the cells of every row it can reach. Scratch memory comes from the arena when one is given.
+void applySplineFlow(VectorField& vf, const FlowSpline* splines, u32 splineCount, JobSystem* jobs = nullptr,
+	FrameArena* arena = nullptr);
@@ -0,0 +1,131 @@
+#include "FlowerStats.h"
+#include "FlowerArena.h"
+#include "FlowerField.h"
+#include "FlowerJobs.h"
+
+static void computeTileStats(TileStats& stats, const VectorField& vf, const FieldRect& rect)
+{
+	static constexpr float binScale = float(TileStats::histogramBinCount) / FieldStats::histogramRange;
+
+	stats = TileStats();
+
+	for (u32 y = rect.y0; y < rect.y1; ++y)
+	{
+		const Vec2* row = vf.data + y * vf.width;
+		const Vec2* rowUp = vf.data + (y ? y - 1 : y) * vf.width;
+		const Vec2* rowDown = vf.data + min(y + 1, vf.height - 1) * vf.width;
+
+		for (u32 x = rect.x0; x < rect.x1; ++x)
+		{
+			const Vec2 v = row[x];
+			const float magnitude = v.length();
+
+			stats.sumX += v.x;
+			stats.sumY += v.y;
+			stats.sumMagnitude += magnitude;
+			stats.maxMagnitude = max(stats.maxMagnitude, magnitude);
+			stats.histogram[min(u32(magnitude * binScale), TileStats::histogramBinCount - 1)]++;
+
+			const float divergence = getDivergence(row[x ? x - 1 : x], row[min(x + 1, vf.width - 1)], rowUp[x], rowDown[x]);
+			stats.divergenceEnergy += divergence * divergence;
+		}
+	}
+}
+
+static void addTileStats(TileStats& total, const TileStats& tile)
+{
+	total.sumX += tile.sumX;
+	total.sumY += tile.sumY;
+	total.sumMagnitude += tile.sumMagnitude;
+	total.divergenceEnergy += tile.divergenceEnergy;
+
+	for (u32 i = 0; i < TileStats::histogramBinCount; ++i)
+	{
+		total.histogram[i] += tile.histogram[i];
+	}
+}
+
+static void removeTileStats(TileStats& total, const TileStats& tile)
+{
+	total.sumX -= tile.sumX;
+	total.sumY -= tile.sumY;
+	total.sumMagnitude -= tile.sumMagnitude;
+	total.divergenceEnergy -= tile.divergenceEnergy;
+
+	for (u32 i = 0; i < TileStats::histogramBinCount; ++i)
+	{
+		total.histogram[i] -= tile.histogram[i];
+	}
+}
+
+u32 updateFieldStats(FieldStats& stats, const VectorField& vf, JobSystem* jobs, FrameArena* arena)
+{
+	const u32 tileCount = u32(vf.tileRevisions.size());
+
+	if (stats.source.field != &vf || stats.tiles.size() != tileCount || stats.cellCount != vf.count)
+	{
+		resetFieldTileCache(stats.source, vf);
+		stats.tiles.assign(tileCount, TileStats());
+		stats.total = TileStats();
+		stats.cellCount = vf.count;
+	}
+
+	// Divergence at tile edges reads the neighboring tiles, so changes spread to them
+	FrameArray<u32> dirtyTiles(arena, tileCount);
+	const u32 dirtyCount = collectDirtyTiles(stats.source, vf, 1, dirtyTiles.data);
+
+	if (!dirtyCount) return 0;
+
+	for (u32 i = 0; i < dirtyCount; ++i)
+	{
+		removeTileStats(stats.total, stats.tiles[dirtyTiles[i]]);
+	}
+
+	parallelFor(jobs, dirtyCount, 4, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u32 tileIndex = dirtyTiles[i];
+			computeTileStats(stats.tiles[tileIndex], vf, getTileRect(vf, tileIndex));
+		}
+	});
+
+	for (u32 i = 0; i < dirtyCount; ++i)
+	{
+		addTileStats(stats.total, stats.tiles[dirtyTiles[i]]);
+	}
+
+	// Maximum can not be removed incrementally, but tile maxima are cheap to scan
+	float maxMagnitude = 0.0f;
+	for (const TileStats& tile : stats.tiles)
+	{
+		maxMagnitude = max(maxMagnitude, tile.maxMagnitude);
+	}
+
+	const double invCellCount = vf.count ? 1.0 / double(vf.count) : 0.0;
+	stats.meanVector = Vec2(float(stats.total.sumX * invCellCount), float(stats.total.sumY * invCellCount));
+	stats.meanMagnitude = float(stats.total.sumMagnitude * invCellCount);
+	stats.maxMagnitude = maxMagnitude;
+	stats.divergenceEnergy = float(max(0.0, stats.total.divergenceEnergy));
+
+	return dirtyCount;
+}
+
+float getMagnitudePercentile(const FieldStats& stats, float fraction)
+{
+	static constexpr float binWidth = FieldStats::histogramRange / float(TileStats::histogramBinCount);
+
+	const u32 threshold = u32(fraction * float(stats.cellCount));
+
+	u32 count = 0;
+	for (u32 i = 0; i < TileStats::histogramBinCount; ++i)
+	{
+		count += stats.total.histogram[i];
+		if (count > threshold)
+		{
+			return min(float(i + 1) * binWidth, stats.maxMagnitude);
+		}
+	}
+
+	return stats.maxMagnitude;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "FlowerField.h"
+
+#include <vector>
+
+struct FrameArena;
+
+struct TileStats
+{
+	static constexpr u32 histogramBinCount = 32;
+
+	double sumX = 0.0;
+	double sumY = 0.0;
+	double sumMagnitude = 0.0;
+	double divergenceEnergy = 0.0;
+	float maxMagnitude = 0.0f;
+	u32 histogram[histogramBinCount] = {};
+};
+
+// Field statistics kept per tile and updated only for tiles whose revision changed.
+// Totals are adjusted by removing the old and adding the new stats of each updated tile.
+struct FieldStats
+{
+	// Magnitude histogram covers [0, histogramRange), longer vectors land in the last bin
+	static constexpr float histogramRange = 2.0f;
+
+	FieldTileCache source;
+	std::vector<TileStats> tiles;
+
+	// Totals over the whole field
+	TileStats total;
+	u32 cellCount = 0;
+	Vec2 meanVector = Vec2(0.0f);
+	float meanMagnitude = 0.0f;
+	float maxMagnitude = 0.0f;
+
+	// Sum of squared central difference divergence over all cells
+	float divergenceEnergy = 0.0f;
+};
+
+// Returns the number of tiles that were updated
+u32 updateFieldStats(FieldStats& stats, const VectorField& vf, JobSystem* jobs = nullptr, FrameArena* arena = nullptr);
+
+// Magnitude below which the given fraction of cells lies, at histogram bin resolution
+float getMagnitudePercentile(const FieldStats& stats, float fraction);